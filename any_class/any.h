@@ -1,6 +1,10 @@
 #pragma once
 
-#include <memory>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 
 class Any {
 public:
@@ -8,58 +12,115 @@ public:
 
     template <class T>
     Any(const T& value) {
-        base_ = std::make_unique<Object<T>>(value);
+        Construct(value);
     }
 
     template <class T>
     Any& operator=(const T& value) {
-        base_ = std::make_unique<Object<T>>(value);
+        Any(value).Swap(*this);
         return *this;
     }
 
     Any(const Any& rhs) {
-        base_ = rhs.base_->Clone();
+        if (rhs.vt_ != nullptr) {
+            rhs.vt_->clone(rhs, *this);
+        }
     }
 
     Any& operator=(const Any& rhs) {
-        base_ = rhs.base_->Clone();
+        if (this != &rhs) {
+            Any(rhs).Swap(*this);
+        }
         return *this;
     }
 
-    ~Any() = default;
+    ~Any() {
+        Clear();
+    }
 
     bool Empty() const {
-        return base_ == nullptr;
+        return vt_ == nullptr;
     }
 
     void Clear() {
-        base_ = nullptr;
+        if (vt_ != nullptr) {
+            vt_->destroy(*this);
+            vt_ = nullptr;
+            ptr_ = nullptr;
+        }
     }
 
+    // Inline values are trivially copyable, so swapping the raw buffer bytes
+    // is valid; heap values only need their pointers exchanged.
     void Swap(Any& rhs) {
-        std::swap(base_, rhs.base_);
+        std::swap(buf_, rhs.buf_);
+        std::swap(ptr_, rhs.ptr_);
+        std::swap(vt_, rhs.vt_);
     }
 
     template <class T>
     const T& GetValue() const {
-        return dynamic_cast<const Object<T>&>(*base_.get()).value_;
+        if (vt_ == nullptr || vt_->type_id() != &kTypeTag<T>) {
+            throw std::bad_cast{};
+        }
+        return *static_cast<const T*>(Storage());
     }
 
-    struct BaseAny {
-        virtual ~BaseAny() = default;
-        virtual std::unique_ptr<BaseAny> Clone() = 0;
+private:
+    // Small, trivially copyable values (ints, doubles, pointers) live in
+    // buf_ and never touch the heap; everything else goes through ptr_.
+    // Dispatch is a per-type table of plain function pointers, and type
+    // identity is the address of a per-type tag, so GetValue is a single
+    // pointer comparison instead of a dynamic_cast.
+    struct VTable {
+        void (*destroy)(Any&);
+        void (*clone)(const Any&, Any&);
+        const void* (*type_id)();
     };
 
-    template <typename T>
-    struct Object : public BaseAny {
-        T value_;
-        explicit Object(const T& value) : value_(value) {
+    static constexpr size_t kBufferSize = 24;
+
+    template <class T>
+    static constexpr bool kFitsInline = sizeof(T) <= kBufferSize &&
+                                        alignof(T) <= alignof(std::max_align_t) &&
+                                        std::is_trivially_copyable_v<T>;
+
+    template <class T>
+    static constexpr char kTypeTag = 0;
+
+    template <class T>
+    struct Ops {
+        static void Destroy(Any& any) {
+            if constexpr (!kFitsInline<T>) {
+                delete static_cast<T*>(any.ptr_);
+            }
+        }
+        static void Clone(const Any& from, Any& to) {
+            to.Construct(*static_cast<const T*>(from.Storage()));
         }
-        std::unique_ptr<BaseAny> Clone() override {
-            return std::make_unique<Object<T>>(value_);
+        static const void* TypeId() {
+            return &kTypeTag<T>;
         }
     };
 
-private:
-    std::unique_ptr<BaseAny> base_ = nullptr;
+    template <class T>
+    static constexpr VTable kVTable{&Ops<T>::Destroy, &Ops<T>::Clone, &Ops<T>::TypeId};
+
+    template <class T>
+    void Construct(const T& value) {
+        if constexpr (kFitsInline<T>) {
+            new (buf_) T(value);
+        } else {
+            ptr_ = new T(value);
+        }
+        vt_ = &kVTable<T>;
+    }
+
+    const void* Storage() const {
+        return ptr_ != nullptr ? ptr_ : buf_;
+    }
+
+    alignas(std::max_align_t) std::byte buf_[kBufferSize];
+    void* ptr_ = nullptr;
+    const VTable* vt_ = nullptr;
 };
@@ -7,48 +7,56 @@
 #include <objects_class.h>
 #include <camera_options.h>
 
-const double kComparisonThreshold = 1e-10;
-const double kEpsilon = 1e-8;
+const Scalar kComparisonThreshold = 1e-6f;
+const Scalar kEpsilon = 1e-5f;
 
 struct Ray {
     Vec3 origin{}, direction{};
-    double distance = 0;
+    Scalar distance = 0;
     bool inside = false;
     Ray() = default;
-    Ray(const Vec3& origin, const Vec3& direction_in, const double distance = 0)
+    Ray(const Vec3& origin, const Vec3& direction_in, const Scalar distance = 0)
         : origin(origin), direction(direction_in), distance(distance), inside(false) {
         direction.Normalize();
     }
 };
 
-Ray MakeCameraRay(const CameraOptions& camera_options, int pix_height, int pix_width,
-                  int screen_height, int screen_width) {
-    double aspect_ration = static_cast<double>(screen_width) / screen_height;
-    double x_coord = (2 * (pix_width + 0.5) / screen_width - 1) * std::tan(camera_options.fov / 2) *
-                     aspect_ration;
-    double y_coord =
-        (1 - 2 * (pix_height + 0.5) / screen_height) * std::tan(camera_options.fov / 2);
-    double z_coord = -1;
+// Everything about the camera that is constant for a frame: tan(fov/2) is
+// computed once here instead of twice per pixel, and the screen divisions
+// become multiplications by precomputed reciprocals.
+struct CameraRaySetup {
+    Scalar x_scale, y_scale;
+    Scalar inv_width, inv_height;
+
+    CameraRaySetup(const CameraOptions& camera_options, int screen_height, int screen_width) {
+        Scalar tan_half_fov = std::tan(camera_options.fov / 2);
+        Scalar aspect_ration = static_cast<Scalar>(screen_width) / screen_height;
+        x_scale = tan_half_fov * aspect_ration;
+        y_scale = tan_half_fov;
+        inv_width = 1.0f / screen_width;
+        inv_height = 1.0f / screen_height;
+    }
+};
+
+Ray MakeCameraRay(const CameraRaySetup& setup, int pix_height, int pix_width) {
+    Scalar x_coord = (2 * (pix_width + 0.5f) * setup.inv_width - 1) * setup.x_scale;
+    Scalar y_coord = (1 - 2 * (pix_height + 0.5f) * setup.inv_height) * setup.y_scale;
+    Scalar z_coord = -1;
 
     Vec3 origin{};  // (0, 0, 0)
     Vec3 direction{x_coord, y_coord, z_coord};
     return Ray(origin, direction);
 }
-Vec3 VecProd(const Vec3& first, const Vec3& second) {
-    double x_coord = first.y * second.z - first.z * second.y;
-    double y_coord = first.z * second.x - first.x * second.z;
-    double z_coord = first.x * second.y - first.y * second.x;
+// Camera-to-world rotation stored as three Vec3 rows, so applying it is just
+// three dot products and nothing is heap-allocated.
+using ToWorldMatrix = std::array<Vec3, 3>;
 
-    return Vec3(x_coord, y_coord, z_coord);
-}
-
-void MakeToWorldMatrix(const CameraOptions& camera_options,
-                       std::vector<std::vector<double>>& to_world_matrix) {
+void MakeToWorldMatrix(const CameraOptions& camera_options, ToWorldMatrix& to_world_matrix) {
 
     const std::array<double, 3>& look_from = camera_options.look_from;
     const std::array<double, 3>& look_to = camera_options.look_to;
 
-    Vec3 z_camera{look_from[0] - look_to[0], look_from[1] - look_to[1], look_from[2] - look_to[2]};
+    Vec3 z_camera(look_from[0] - look_to[0], look_from[1] - look_to[1], look_from[2] - look_to[2]);
     z_camera.Normalize();
 
     Vec3 y_axis{0, 1, 0};
@@ -62,104 +70,447 @@ void MakeToWorldMatrix(const CameraOptions& camera_options,
 
     Vec3 y_camera = VecProd(z_camera, x_camera);
 
-    to_world_matrix[0][0] = x_camera.x;
-    to_world_matrix[0][1] = y_camera.x;
-    to_world_matrix[0][2] = z_camera.x;
-
-    to_world_matrix[1][0] = x_camera.y;
-    to_world_matrix[1][1] = y_camera.y;
-    to_world_matrix[1][2] = z_camera.y;
-
-    to_world_matrix[2][0] = x_camera.z;
-    to_world_matrix[2][1] = y_camera.z;
-    to_world_matrix[2][2] = z_camera.z;
+    to_world_matrix[0] = Vec3{x_camera.x, y_camera.x, z_camera.x};
+    to_world_matrix[1] = Vec3{x_camera.y, y_camera.y, z_camera.y};
+    to_world_matrix[2] = Vec3{x_camera.z, y_camera.z, z_camera.z};
 }
 
 Ray CameraToWorld(const Ray& ray, const CameraOptions& camera_options,
-                  const std::vector<std::vector<double>>& matrix) {
+                  const ToWorldMatrix& matrix) {
     Ray transformed;
     const std::array<double, 3>& look_from = camera_options.look_from;
-    transformed.origin = Vec3{look_from[0], look_from[1], look_from[2]};
+    transformed.origin = Vec3(look_from[0], look_from[1], look_from[2]);
 
-    for (int i = 0; i < 3; ++i) {
-        double coord = 0;
-        for (int k = 0; k < 3; ++k) {
-            coord += matrix[i][k] * ray.direction[k];
+    transformed.direction = Vec3{matrix[0] * ray.direction, matrix[1] * ray.direction,
+                                 matrix[2] * ray.direction};
+    return transformed;
+}
+bool Intersection(const Ray& ray, const HotPrim& prim, Scalar* distance);
+
+// Smits slab test: tmin is the entry distance along the ray, zero if the
+// origin is already inside the box.
+bool IntersectionAABB(const Ray& ray, const Vec3& inv_dir, const AABB& bbox, Scalar* tmin_out) {
+    Scalar tmin = 0;
+    Scalar tmax = kMaxDistance;
+    for (int axis = 0; axis < 3; ++axis) {
+        Scalar t0 = (bbox.min[axis] - ray.origin[axis]) * inv_dir[axis];
+        Scalar t1 = (bbox.max[axis] - ray.origin[axis]) * inv_dir[axis];
+        if (inv_dir[axis] < 0) {
+            std::swap(t0, t1);
         }
-        transformed.direction[i] = coord;
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
     }
-    return transformed;
+
+    if (tmax < tmin) {
+        return false;
+    }
+    *tmin_out = tmin;
+    return true;
 }
-bool Intersection(const Ray& ray, const Object& object, double* distance);
 
 bool Trace(Ray* ray, const ObjectSet& objects, const Object** object) {
     //если мы находимся внутри объекта а?а?а?
 
-    double min_dist = 0;
-    bool found = false;
-    for (size_t i = 0; i < objects.Size(); ++i) {
-        double distance = 0;
-        if (Intersection(*ray, objects[i], &distance) &&
-            (distance < min_dist - kComparisonThreshold || !found)) {
-            min_dist = distance;
-            *object = &objects[i];
-            found = true;
+    // Seeding the nearest-hit search with +INF (instead of a found flag and
+    // a zero seed the first hit overwrote) keeps the update a plain minimum.
+    Scalar best = kMaxDistance;
+    const Object* hit = nullptr;
+
+    const BVH& bvh = objects.Bvh();
+    if (bvh.Nodes().empty()) {
+        ray->distance = 0;
+        return false;
+    }
+
+    Vec3 inv_dir{1 / ray->direction.x, 1 / ray->direction.y, 1 / ray->direction.z};
+
+    struct StackEntry {
+        uint32_t node;
+        Scalar tmin;
+    };
+    StackEntry stack[64];
+    int stack_size = 0;
+
+    Scalar root_tmin = 0;
+    if (!IntersectionAABB(*ray, inv_dir, bvh.Nodes()[0].bbox, &root_tmin)) {
+        ray->distance = 0;
+        return false;
+    }
+    stack[stack_size++] = StackEntry{0, root_tmin};
+
+    while (stack_size > 0) {
+        StackEntry entry = stack[--stack_size];
+        if (entry.tmin > best) {
+            continue;
+        }
+        const BVH::Node& node = bvh.Nodes()[entry.node];
+
+        if (node.prim_count > 0) {
+            for (uint32_t i = node.first_prim; i < node.first_prim + node.prim_count; ++i) {
+                const HotPrim& prim = objects.HotPrims()[i];
+                Scalar distance = 0;
+                if (Intersection(*ray, prim, &distance) && distance > kEpsilon &&
+                    distance < best) {
+                    best = distance;
+                    hit = &objects[prim.object_index];
+                }
+            }
+            continue;
+        }
+
+        uint32_t near_child = node.left;
+        uint32_t far_child = node.right;
+        Scalar near_tmin = 0, far_tmin = 0;
+        bool hit_near = IntersectionAABB(*ray, inv_dir, bvh.Nodes()[near_child].bbox, &near_tmin);
+        bool hit_far = IntersectionAABB(*ray, inv_dir, bvh.Nodes()[far_child].bbox, &far_tmin);
+
+        if (hit_near && hit_far && far_tmin < near_tmin) {
+            std::swap(near_child, far_child);
+            std::swap(near_tmin, far_tmin);
+            std::swap(hit_near, hit_far);
+        }
+        if (hit_far) {
+            stack[stack_size++] = StackEntry{far_child, far_tmin};
         }
+        if (hit_near) {
+            stack[stack_size++] = StackEntry{near_child, near_tmin};
+        }
+        assert(stack_size <= 64);
     }
 
-    ray->distance = min_dist;
-    return found;
+    *object = hit;
+    ray->distance = (hit != nullptr) ? best : 0;
+    return hit != nullptr;
 }
 
-bool IntersectionSphere(const Ray& ray, const Object& object, double* distance) {
-    double b_coef = 2 * ray.direction * (ray.origin - object.Center());
-    double c_coef = (ray.origin - object.Center()) * (ray.origin - object.Center()) -
-                    object.Radius() * object.Radius();
-
-    double discr = b_coef * b_coef - 4 * c_coef;
-    if (discr < 0) {
+// Occlusion query: any primitive closer than max_distance ends the traversal
+// immediately, so there is no nearest-hit bookkeeping and no child ordering.
+bool TraceAny(const Ray& ray, const ObjectSet& objects, Scalar max_distance) {
+    const BVH& bvh = objects.Bvh();
+    if (bvh.Nodes().empty()) {
         return false;
     }
-    discr = std::sqrt(discr);
-    int sign_b = (b_coef < 0 - kComparisonThreshold) ? -1 : 1;
-    double x0 = -(b_coef + sign_b * discr) / 2;
-    double x1 = c_coef / x0;
 
-    if (x1 < x0 - kComparisonThreshold) {
-        std::swap(x0, x1);
+    Vec3 inv_dir{1 / ray.direction.x, 1 / ray.direction.y, 1 / ray.direction.z};
+
+    uint32_t stack[64];
+    int stack_size = 0;
+
+    Scalar root_tmin = 0;
+    if (!IntersectionAABB(ray, inv_dir, bvh.Nodes()[0].bbox, &root_tmin) ||
+        root_tmin >= max_distance) {
+        return false;
     }
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const BVH::Node& node = bvh.Nodes()[stack[--stack_size]];
+
+        if (node.prim_count > 0) {
+            for (uint32_t i = node.first_prim; i < node.first_prim + node.prim_count; ++i) {
+                const HotPrim& prim = objects.HotPrims()[i];
+                Scalar distance = 0;
+                if (Intersection(ray, prim, &distance) && distance > kEpsilon &&
+                    distance < max_distance - kComparisonThreshold) {
+                    return true;
+                }
+            }
+            continue;
+        }
 
-    if (x0 > 0 + kComparisonThreshold) {
-        *distance = x0;
-        return true;
-    } else if (x1 > 0 + kComparisonThreshold) {
-        *distance = x1;
-        return true;
+        Scalar tmin = 0;
+        if (IntersectionAABB(ray, inv_dir, bvh.Nodes()[node.left].bbox, &tmin) &&
+            tmin < max_distance) {
+            stack[stack_size++] = node.left;
+        }
+        if (IntersectionAABB(ray, inv_dir, bvh.Nodes()[node.right].bbox, &tmin) &&
+            tmin < max_distance) {
+            stack[stack_size++] = node.right;
+        }
+        assert(stack_size <= 64);
     }
 
     return false;
 }
 
-Vec3 MakeNormal(const Vertex& one, const Vertex& two, const Vertex& three) {
-    Vec3 cut_one = two.vertex - one.vertex;
-    Vec3 cut_two = three.vertex - one.vertex;
-    return VecProd(cut_one, cut_two);
+// The eight-wide kernels below carry their own target attribute, so the
+// translation unit can be compiled for an SSE4.2 baseline and still emit
+// AVX2+FMA code here. HasAvx2() is the matching runtime switch: the packet
+// entry points are only taken when the CPU reports both features, and
+// everything else falls back to the scalar pipeline above.
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define SHAD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define SHAD_TARGET_AVX2
+#endif
+
+bool HasAvx2() {
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }();
+    return supported;
+}
+
+// Eight coherent rays in SoA form so one primitive test fills all AVX lanes.
+struct RayPacket8 {
+    __m256 ox, oy, oz;
+    __m256 dx, dy, dz;
+
+    SHAD_TARGET_AVX2 explicit RayPacket8(const Ray rays[8]) {
+        ox = _mm256_set_ps(rays[7].origin.x, rays[6].origin.x, rays[5].origin.x, rays[4].origin.x,
+                           rays[3].origin.x, rays[2].origin.x, rays[1].origin.x, rays[0].origin.x);
+        oy = _mm256_set_ps(rays[7].origin.y, rays[6].origin.y, rays[5].origin.y, rays[4].origin.y,
+                           rays[3].origin.y, rays[2].origin.y, rays[1].origin.y, rays[0].origin.y);
+        oz = _mm256_set_ps(rays[7].origin.z, rays[6].origin.z, rays[5].origin.z, rays[4].origin.z,
+                           rays[3].origin.z, rays[2].origin.z, rays[1].origin.z, rays[0].origin.z);
+        dx = _mm256_set_ps(rays[7].direction.x, rays[6].direction.x, rays[5].direction.x,
+                           rays[4].direction.x, rays[3].direction.x, rays[2].direction.x,
+                           rays[1].direction.x, rays[0].direction.x);
+        dy = _mm256_set_ps(rays[7].direction.y, rays[6].direction.y, rays[5].direction.y,
+                           rays[4].direction.y, rays[3].direction.y, rays[2].direction.y,
+                           rays[1].direction.y, rays[0].direction.y);
+        dz = _mm256_set_ps(rays[7].direction.z, rays[6].direction.z, rays[5].direction.z,
+                           rays[4].direction.z, rays[3].direction.z, rays[2].direction.z,
+                           rays[1].direction.z, rays[0].direction.z);
+    }
+};
+
+SHAD_TARGET_AVX2 __m256 Dot8(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+    // Fused multiply-adds halve the instruction count and keep the products
+    // unrounded; the compiler does not reliably contract the hand-written
+    // mul/add form.
+    return _mm256_fmadd_ps(ax, bx, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(az, bz)));
+}
+
+SHAD_TARGET_AVX2 __m256 Abs8(__m256 value) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), value);
+}
+
+// Möller-Trumbore test of one triangle against eight rays; returns the lane
+// mask of hits and writes the per-lane distance.
+SHAD_TARGET_AVX2 __m256 IntersectionTriangle8(const RayPacket8& packet, const Vec3& v1,
+                                              const Vec3& edge1, const Vec3& edge2,
+                                              __m256* distance) {
+    __m256 e1x = _mm256_set1_ps(edge1.x), e1y = _mm256_set1_ps(edge1.y),
+           e1z = _mm256_set1_ps(edge1.z);
+    __m256 e2x = _mm256_set1_ps(edge2.x), e2y = _mm256_set1_ps(edge2.y),
+           e2z = _mm256_set1_ps(edge2.z);
+
+    // pvec = direction x edge2
+    __m256 px = _mm256_fmsub_ps(packet.dy, e2z, _mm256_mul_ps(packet.dz, e2y));
+    __m256 py = _mm256_fmsub_ps(packet.dz, e2x, _mm256_mul_ps(packet.dx, e2z));
+    __m256 pz = _mm256_fmsub_ps(packet.dx, e2y, _mm256_mul_ps(packet.dy, e2x));
+
+    __m256 det = Dot8(e1x, e1y, e1z, px, py, pz);
+    __m256 eps = _mm256_set1_ps(kComparisonThreshold);
+    __m256 mask = _mm256_cmp_ps(Abs8(det), eps, _CMP_GE_OQ);
+    if (_mm256_movemask_ps(mask) == 0) {
+        return mask;
+    }
+    __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+    __m256 tx = _mm256_sub_ps(packet.ox, _mm256_set1_ps(v1.x));
+    __m256 ty = _mm256_sub_ps(packet.oy, _mm256_set1_ps(v1.y));
+    __m256 tz = _mm256_sub_ps(packet.oz, _mm256_set1_ps(v1.z));
+
+    // Strict barycentric bounds: boundary hits that the scalar test would
+    // reject must not sneak in, they can become the tone-mapping maximum.
+    __m256 u_coord = _mm256_mul_ps(Dot8(tx, ty, tz, px, py, pz), inv_det);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one_vec = _mm256_set1_ps(1.0f);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u_coord, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u_coord, one_vec, _CMP_LE_OQ));
+
+    // qvec = tvec x edge1
+    __m256 qx = _mm256_fmsub_ps(ty, e1z, _mm256_mul_ps(tz, e1y));
+    __m256 qy = _mm256_fmsub_ps(tz, e1x, _mm256_mul_ps(tx, e1z));
+    __m256 qz = _mm256_fmsub_ps(tx, e1y, _mm256_mul_ps(ty, e1x));
+
+    __m256 v_coord = _mm256_mul_ps(Dot8(packet.dx, packet.dy, packet.dz, qx, qy, qz), inv_det);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v_coord, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask,
+                         _mm256_cmp_ps(_mm256_add_ps(u_coord, v_coord), one_vec, _CMP_LE_OQ));
+
+    __m256 length = _mm256_mul_ps(Dot8(e2x, e2y, e2z, qx, qy, qz), inv_det);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(length, zero, _CMP_GE_OQ));
+
+    *distance = length;
+    return mask;
+}
+
+SHAD_TARGET_AVX2 __m256 IntersectionSphere8(const RayPacket8& packet, const Vec3& center,
+                                            Scalar radius, __m256* distance) {
+    __m256 lx = _mm256_sub_ps(packet.ox, _mm256_set1_ps(center.x));
+    __m256 ly = _mm256_sub_ps(packet.oy, _mm256_set1_ps(center.y));
+    __m256 lz = _mm256_sub_ps(packet.oz, _mm256_set1_ps(center.z));
+
+    __m256 b_coef =
+        _mm256_mul_ps(_mm256_set1_ps(2.0f), Dot8(packet.dx, packet.dy, packet.dz, lx, ly, lz));
+    __m256 c_coef = _mm256_sub_ps(Dot8(lx, ly, lz, lx, ly, lz),
+                                  _mm256_set1_ps(radius * radius));
+
+    __m256 discr =
+        _mm256_fmsub_ps(b_coef, b_coef, _mm256_mul_ps(_mm256_set1_ps(4.0f), c_coef));
+    __m256 mask = _mm256_cmp_ps(discr, _mm256_setzero_ps(), _CMP_GE_OQ);
+    if (_mm256_movemask_ps(mask) == 0) {
+        return mask;
+    }
+    discr = _mm256_sqrt_ps(_mm256_max_ps(discr, _mm256_setzero_ps()));
+
+    // x0 = -(b + sign(b) * sqrt(discr)) / 2, x1 = c / x0 (stable root pair)
+    __m256 sign_b = _mm256_or_ps(_mm256_and_ps(b_coef, _mm256_set1_ps(-0.0f)),
+                                 _mm256_set1_ps(1.0f));
+    __m256 x0 = _mm256_mul_ps(_mm256_set1_ps(-0.5f),
+                              _mm256_add_ps(b_coef, _mm256_mul_ps(sign_b, discr)));
+    __m256 x1 = _mm256_div_ps(c_coef, x0);
+
+    __m256 near_root = _mm256_min_ps(x0, x1);
+    __m256 far_root = _mm256_max_ps(x0, x1);
+
+    __m256 eps = _mm256_set1_ps(kComparisonThreshold);
+    __m256 near_valid = _mm256_cmp_ps(near_root, eps, _CMP_GT_OQ);
+    __m256 root = _mm256_blendv_ps(far_root, near_root, near_valid);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(root, eps, _CMP_GT_OQ));
+
+    *distance = root;
+    return mask;
+}
+
+SHAD_TARGET_AVX2 __m256 Intersection8(const RayPacket8& packet, const HotPrim& prim,
+                                      __m256* distance) {
+    if (prim.type == ObjType::Sphere) {
+        return IntersectionSphere8(packet, prim.v1, prim.radius, distance);
+    }
+    return IntersectionTriangle8(packet, prim.v1, prim.edge_u, prim.edge_v, distance);
+}
+
+SHAD_TARGET_AVX2 __m256 IntersectionAABB8(const RayPacket8& packet, __m256 inv_dx, __m256 inv_dy,
+                                          __m256 inv_dz, const AABB& bbox, __m256* tmin_out) {
+    __m256 tmin = _mm256_setzero_ps();
+    __m256 tmax = _mm256_set1_ps(kMaxDistance);
+
+    __m256 inv_dir[3] = {inv_dx, inv_dy, inv_dz};
+    __m256 origin[3] = {packet.ox, packet.oy, packet.oz};
+    for (int axis = 0; axis < 3; ++axis) {
+        // (slab - o) * inv == fms(slab, inv, o * inv); the o * inv term is
+        // shared between the two planes.
+        __m256 origin_inv = _mm256_mul_ps(origin[axis], inv_dir[axis]);
+        __m256 t0 = _mm256_fmsub_ps(_mm256_set1_ps(bbox.min[axis]), inv_dir[axis], origin_inv);
+        __m256 t1 = _mm256_fmsub_ps(_mm256_set1_ps(bbox.max[axis]), inv_dir[axis], origin_inv);
+        tmin = _mm256_max_ps(tmin, _mm256_min_ps(t0, t1));
+        tmax = _mm256_min_ps(tmax, _mm256_max_ps(t0, t1));
+    }
+
+    *tmin_out = tmin;
+    return _mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ);
 }
 
-bool IntersectionTriangle(const Ray& ray, const Object& object, double* distance) {
-    Vec3 normal{};
-    const Vertex& one = object(0);
-    const Vertex& two = object(1);
-    const Vertex& three = object(2);
+// Traces eight coherent rays through the BVH in one traversal. Writes the
+// per-lane index of the nearest object (-1 when the lane missed) and the
+// per-lane hit distance.
+SHAD_TARGET_AVX2 void TracePacket8(const RayPacket8& packet, const ObjectSet& objects,
+                                   int* hit_index, Scalar* hit_distance) {
+    for (int lane = 0; lane < 8; ++lane) {
+        hit_index[lane] = -1;
+        hit_distance[lane] = 0;
+    }
+    const BVH& bvh = objects.Bvh();
+    if (bvh.Nodes().empty()) {
+        return;
+    }
+
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 inv_dx = _mm256_div_ps(one, packet.dx);
+    __m256 inv_dy = _mm256_div_ps(one, packet.dy);
+    __m256 inv_dz = _mm256_div_ps(one, packet.dz);
+
+    __m256 min_dist = _mm256_set1_ps(kMaxDistance);
+    // lane object indices kept as floats so they blend with the hit masks
+    __m256 index = _mm256_set1_ps(-1.0f);
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const BVH::Node& node = bvh.Nodes()[stack[--stack_size]];
 
-    normal = MakeNormal(one, two, three);
+        __m256 node_tmin{};
+        __m256 node_mask = IntersectionAABB8(packet, inv_dx, inv_dy, inv_dz, node.bbox,
+                                             &node_tmin);
+        node_mask = _mm256_and_ps(node_mask, _mm256_cmp_ps(node_tmin, min_dist, _CMP_LE_OQ));
+        if (_mm256_movemask_ps(node_mask) == 0) {
+            continue;
+        }
+
+        if (node.prim_count > 0) {
+            for (uint32_t i = node.first_prim; i < node.first_prim + node.prim_count; ++i) {
+                const HotPrim& prim = objects.HotPrims()[i];
+                __m256 distance{};
+                __m256 mask = Intersection8(packet, prim, &distance);
+                mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, _mm256_set1_ps(kEpsilon),
+                                                         _CMP_GT_OQ));
+                mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, min_dist, _CMP_LT_OQ));
+                min_dist = _mm256_blendv_ps(min_dist, distance, mask);
+                index = _mm256_blendv_ps(
+                    index, _mm256_set1_ps(static_cast<Scalar>(prim.object_index)), mask);
+            }
+            continue;
+        }
 
-    double denominator = ray.direction * normal;
+        stack[stack_size++] = node.right;
+        stack[stack_size++] = node.left;
+        assert(stack_size <= 64);
+    }
+
+    alignas(32) Scalar index_lanes[8];
+    alignas(32) Scalar dist_lanes[8];
+    _mm256_store_ps(index_lanes, index);
+    _mm256_store_ps(dist_lanes, min_dist);
+    for (int lane = 0; lane < 8; ++lane) {
+        if (index_lanes[lane] >= 0) {
+            hit_index[lane] = static_cast<int>(index_lanes[lane]);
+            hit_distance[lane] = dist_lanes[lane];
+        }
+    }
+}
+
+bool IntersectionSphere(const Ray& ray, const Vec3& center, Scalar radius, Scalar* distance) {
+    Scalar b_coef = 2 * ray.direction * (ray.origin - center);
+    Scalar c_coef = (ray.origin - center) * (ray.origin - center) - radius * radius;
+
+    Scalar discr = b_coef * b_coef - 4 * c_coef;
+    if (discr < 0) {
+        return false;
+    }
+    // Stable root pair, ordered and selected without data-dependent branches:
+    // copysign/fmin/fmax compile to branch-free SSE instructions and the
+    // nearest-positive pick becomes a conditional move.
+    Scalar q = -Scalar(0.5) * (b_coef + std::copysign(std::sqrt(discr), b_coef));
+    Scalar x0 = q;
+    Scalar x1 = c_coef / q;
+
+    Scalar t_near = std::fmin(x0, x1);
+    Scalar t_far = std::fmax(x0, x1);
+    Scalar t = (t_near > kComparisonThreshold) ? t_near : t_far;
+    if (t > kComparisonThreshold) {
+        *distance = t;
+        return true;
+    }
+
+    return false;
+}
+
+bool IntersectionTriangle(const Ray& ray, const Vec3& v1, const Vec3& edge_u, const Vec3& edge_v,
+                          const Vec3& normal, Scalar* distance) {
+    Scalar denominator = ray.direction * normal;
     if (fabs(denominator) < kComparisonThreshold) {
         return false;
     }
-    double nominator = one.vertex * normal - ray.origin * normal;
-    double length = nominator / denominator;
+    Scalar nominator = v1 * normal - ray.origin * normal;
+    Scalar length = nominator / denominator;
 
     if (length < 0 - kComparisonThreshold) {
         return false;
@@ -167,54 +518,57 @@ bool IntersectionTriangle(const Ray& ray, const Object& object, double* distance
 
     Vec3 hit_point = ray.origin + length * ray.direction;
 
-    Vec3 edge_12 = two.vertex - one.vertex;
-    Vec3 point_1 = hit_point - one.vertex;
-    if (VecProd(edge_12, point_1) * normal < 0 - kComparisonThreshold) {
+    Vec3 point_1 = hit_point - v1;
+    if (VecProd(edge_u, point_1) * normal < 0 - kComparisonThreshold) {
         return false;
     }
 
-    Vec3 edge_23 = three.vertex - two.vertex;
-    Vec3 point_2 = hit_point - two.vertex;
+    // edge v2->v3 == edge_v - edge_u; offsets from v2 and v3 are point_1
+    // minus the corresponding edge.
+    Vec3 edge_23 = edge_v - edge_u;
+    Vec3 point_2 = point_1 - edge_u;
     if (VecProd(edge_23, point_2) * normal < 0 - kComparisonThreshold) {
         return false;
     }
 
-    Vec3 edge_31 = one.vertex - three.vertex;
-    Vec3 point_3 = hit_point - three.vertex;
-    if (VecProd(edge_31, point_3) * normal < 0 - kComparisonThreshold) {
+    Vec3 point_3 = point_1 - edge_v;
+    if (VecProd(point_3, edge_v) * normal < 0 - kComparisonThreshold) {
         return false;
     }
 
-    //    std::cout << hit_point.x << ' ' << hit_point.y << ' ' << hit_point.z << '\n';
     *distance = length;
     return true;
 }
 
-bool Intersection(const Ray& ray, const Object& object, double* distance) {
-    if (object.Type() == ObjType::Sphere) {
-        return IntersectionSphere(ray, object, distance);
+bool Intersection(const Ray& ray, const HotPrim& prim, Scalar* distance) {
+    if (prim.type == ObjType::Sphere) {
+        return IntersectionSphere(ray, prim.v1, prim.radius, distance);
     }
-    return IntersectionTriangle(ray, object, distance);
-}
-
-double GetSpace(const Vec3& one, const Vec3& two, const Vec3& three) {
-    return VecProd(two - one, three - one).Length() / 2;
+    return IntersectionTriangle(ray, prim.v1, prim.edge_u, prim.edge_v, prim.normal, distance);
 }
 
 Vec3 InterpolateNormal(const Object& object, const Vec3& hit_point) {
+    assert(object.InvDenom() != 0);
 
-    const Vertex& one = object(0);
-    const Vertex& two = object(1);
-    const Vertex& three = object(2);
+    // Barycentric coordinates from the precomputed edge dot products instead
+    // of three sub-triangle areas.
+    Vec3 to_hit = hit_point - object(0).vertex;
+    Scalar wu = to_hit * object.EdgeU();
+    Scalar wv = to_hit * object.EdgeV();
 
-    double space = GetSpace(one.vertex, two.vertex, three.vertex);
-    assert(space != 0);
+    Scalar v2_coord = (object.VV() * wu - object.UV() * wv) * object.InvDenom();
+    Scalar v3_coord = (object.UU() * wv - object.UV() * wu) * object.InvDenom();
+    Scalar v1_coord = 1 - v2_coord - v3_coord;
 
-    double v1_coord = GetSpace(hit_point, two.vertex, three.vertex) / space;
-    double v2_coord = GetSpace(hit_point, one.vertex, three.vertex) / space;
-    double v3_coord = GetSpace(hit_point, two.vertex, one.vertex) / space;
+    return (v1_coord * object(0).vn + v2_coord * object(1).vn + v3_coord * object(2).vn)
+        .Normalize();
+}
 
-    return (v1_coord * one.vn + v2_coord * two.vn + v3_coord * three.vn).Normalize();
+// Self-intersection bias scaled to the magnitude of the point, so it stays
+// above the float ulp for scenes far from the origin.
+Scalar OriginBias(const Vec3& point) {
+    Scalar magnitude = std::max(fabs(point.x), std::max(fabs(point.y), fabs(point.z)));
+    return kEpsilon * std::max(Scalar(1), magnitude);
 }
 
 bool VisibleLight(const LightSource& light, const Vec3& hit_point, const ObjectSet& objects,
@@ -224,30 +578,76 @@ bool VisibleLight(const LightSource& light, const Vec3& hit_point, const ObjectS
         return false;
     }
 
-    double light_distance = to_light.Length();
+    Scalar light_distance = to_light.Length();
 
     to_light.Normalize();
-    Ray ray(hit_point + kEpsilon * to_light, to_light);
-    const Object* obj{};
-    if (Trace(&ray, objects, &obj) && (ray.distance < light_distance - kComparisonThreshold)) {
-        return false;
+    Ray ray(hit_point + OriginBias(hit_point) * to_light, to_light);
+    return !TraceAny(ray, objects, light_distance);
+}
+
+// Visibility of one block of at most eight lights starting at first, as a
+// bitmask over the block, so any light count works without a whole-scene
+// mask. Blocks of four or more lights share a single packet traversal and
+// the upper BVH nodes are loaded once per block instead of once per light;
+// smaller blocks keep the scalar early-exit query, which wins when lanes
+// would sit idle.
+uint32_t VisibleLights8(const Vec3& hit_point, const Vec3& normal,
+                        const std::vector<LightSource>& sources, size_t first,
+                        const ObjectSet& objects) {
+    size_t block = std::min<size_t>(8, sources.size() - first);
+    uint32_t mask = 0;
+
+    if (block < 4 || !HasAvx2()) {
+        for (size_t i = 0; i < block; ++i) {
+            if (VisibleLight(sources[first + i], hit_point, objects, normal)) {
+                mask |= uint32_t(1) << i;
+            }
+        }
+        return mask;
     }
 
-    return true;
+    Ray rays[8];
+    Scalar light_distance[8];
+    uint32_t facing = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        const LightSource& source = sources[first + std::min(i, block - 1)];
+        Vec3 to_light = Vec3(source.place - hit_point);
+        if (normal * to_light >= 0 - kComparisonThreshold) {
+            facing |= uint32_t(1) << i;
+        }
+        light_distance[i] = to_light.Length();
+        to_light.Normalize();
+        rays[i] = Ray(hit_point + OriginBias(hit_point) * to_light, to_light);
+    }
+
+    RayPacket8 packet(rays);
+    int occluder[8];
+    Scalar occluder_distance[8];
+    TracePacket8(packet, objects, occluder, occluder_distance);
+
+    for (size_t i = 0; i < block; ++i) {
+        bool occluded = occluder[i] >= 0 &&
+                        occluder_distance[i] < light_distance[i] - kComparisonThreshold;
+        if ((facing & (uint32_t(1) << i)) && !occluded) {
+            mask |= uint32_t(1) << i;
+        }
+    }
+
+    return mask;
 }
 
-Ray Refraction(const Ray& ray, const Vec3 normal, const double n_one, const double n_two,
+Ray Refraction(const Ray& ray, const Vec3 normal, const Scalar n_one, const Scalar n_two,
                const Vec3& origin) {
     assert(n_two != 0);
-    double cos_1 = -(ray.direction * normal);
-    double sin_1 = std::sqrt(1 - cos_1 * cos_1);
+    Scalar cos_1 = -(ray.direction * normal);
+    Scalar sin_1 = std::sqrt(1 - cos_1 * cos_1);
 
-    double sin_2 = n_one * sin_1 / n_two;
+    Scalar sin_2 = n_one * sin_1 / n_two;
     if (sin_2 > 1 + kComparisonThreshold) {
         assert(0);
     }
 
-    double cos_2 = std::sqrt(1 - sin_2 * sin_2);
+    Scalar cos_2 = std::sqrt(1 - sin_2 * sin_2);
 
     Vec3 mvec = n_one / n_two * (ray.direction + normal * cos_1);
     Ray refracted(origin, mvec - normal * cos_2);
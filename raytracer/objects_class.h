@@ -2,77 +2,110 @@
 #define SHAD_CPP0_OBJECTS_CLASS_H
 
 #include <cassert>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cmath>
+#include <limits>
 #include <algorithm>
+#include <array>
+#include <immintrin.h>
 
 enum class ObjType { Triangle, Sphere, None };
 
-struct Vec3 {
-    double x = 0, y = 0, z = 0;
+// Single precision is plenty for scenes at this scale and doubles the SIMD
+// lane count over double everywhere in the tracer.
+using Scalar = float;
 
-    Vec3() = default;
-    explicit Vec3(double x, double y, double z) : x(x), y(y), z(z) {
+// Three floats packed into one SSE register (the fourth lane is kept at
+// zero), so +/-/* and dot products run on all components at once.
+struct alignas(16) Vec3 {
+    union {
+        __m128 v;
+        struct {
+            Scalar x, y, z;
+        };
+        Scalar e[4];
+    };
+
+    Vec3() : v(_mm_setzero_ps()) {
+    }
+    explicit Vec3(Scalar x, Scalar y, Scalar z) : v(_mm_set_ps(0, z, y, x)) {
+    }
+    explicit Vec3(__m128 v) : v(v) {
     }
 
     Vec3& Normalize() {
-        double length = std::sqrt(x * x + y * y + z * z);
-        assert(length != 0);
-        x /= length;
-        y /= length;
-        z /= length;
+        Scalar length_sq = *this * *this;
+        assert(length_sq != 0);
+        // rsqrt estimate refined by one Newton step is accurate to ~22 bits,
+        // plenty for a unit vector, and skips both the sqrt and the divide.
+        __m128 inv = _mm_rsqrt_ss(_mm_set_ss(length_sq));
+        inv = _mm_mul_ss(inv, _mm_sub_ss(_mm_set_ss(1.5f), _mm_mul_ss(_mm_set_ss(0.5f * length_sq),
+                                                                      _mm_mul_ss(inv, inv))));
+        v = _mm_mul_ps(v, _mm_shuffle_ps(inv, inv, _MM_SHUFFLE(0, 0, 0, 0)));
         return *this;
     }
 
-    const double& operator[](int index) const {
+    const Scalar& operator[](int index) const {
         assert(index >= 0 && index < 3);
-        switch (index) {
-            case 0:
-                return x;
-            case 1:
-                return y;
-            case 2:
-                return z;
-            default:
-                return x;
-        }
+        return e[index];
     }
 
-    double& operator[](int index) {
-        const Vec3& const_this = *this;
-        return const_cast<double&>(const_this.operator[](index));  // NOLINT
+    Scalar& operator[](int index) {
+        assert(index >= 0 && index < 3);
+        return e[index];
     }
 
-    double operator*(const Vec3& other) const {
-        return x * other.x + y * other.y + z * other.z;
+    Scalar operator*(const Vec3& other) const {
+        return _mm_cvtss_f32(_mm_dp_ps(v, other.v, 0x71));
     }
 
-    Vec3 operator*(const double num) const {
-        return Vec3(num * x, num * y, num * z);
+    Vec3 operator*(const Scalar num) const {
+        return Vec3(_mm_mul_ps(v, _mm_set1_ps(num)));
     }
 
     Vec3 operator-(const Vec3& other) const {
-        return Vec3(x - other.x, y - other.y, z - other.z);
+        return Vec3(_mm_sub_ps(v, other.v));
+    }
+
+    // Sign-bit flip; cheaper than multiplying by -1.
+    Vec3 operator-() const {
+        return Vec3(_mm_xor_ps(v, _mm_set1_ps(-0.0f)));
     }
 
     Vec3 operator+(const Vec3& other) const {
-        return Vec3(x + other.x, y + other.y, z + other.z);
+        return Vec3(_mm_add_ps(v, other.v));
     }
 
-    double Length() const {
-        return std::sqrt(x * x + y * y + z * z);
+    Scalar Length() const {
+        return std::sqrt(*this * *this);
     }
 };
 
-Vec3 operator*(double num, const Vec3& vec) {
+Vec3 operator*(Scalar num, const Vec3& vec) {
     return vec * num;
 }
 
+Vec3 VecProd(const Vec3& first, const Vec3& second) {
+    // a * b.yzx - a.yzx * b gives the cross product rotated to zxy; one more
+    // yzx shuffle brings it back in order.
+    __m128 a_yzx = _mm_shuffle_ps(first.v, first.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(second.v, second.v, _MM_SHUFFLE(3, 0, 2, 1));
+#if defined(__FMA__)
+    __m128 prod = _mm_fmsub_ps(first.v, b_yzx, _mm_mul_ps(a_yzx, second.v));
+#else
+    // Scalar pipeline code must run on the SSE baseline, so no FMA here.
+    __m128 prod = _mm_sub_ps(_mm_mul_ps(first.v, b_yzx), _mm_mul_ps(a_yzx, second.v));
+#endif
+    return Vec3(_mm_shuffle_ps(prod, prod, _MM_SHUFFLE(3, 0, 2, 1)));
+}
+
 struct RGBProperty {
-    double r = 0, g = 0, b = 0;
+    Scalar r = 0, g = 0, b = 0;
     RGBProperty() = default;
-    RGBProperty(double r, double g, double b) : r(r), g(g), b(b) {
+    RGBProperty(Scalar r, Scalar g, Scalar b) : r(r), g(g), b(b) {
     }
     RGBProperty operator+(const RGBProperty& rhs) const {
         return RGBProperty(r + rhs.r, g + rhs.g, b + rhs.b);
@@ -93,59 +126,65 @@ struct RGBProperty {
     }
 };
 
-RGBProperty operator*(const RGBProperty& rgb, double num) {
+RGBProperty operator*(const RGBProperty& rgb, Scalar num) {
     return RGBProperty(rgb.r * num, rgb.g * num, rgb.b * num);
 }
-RGBProperty operator*(double num, const RGBProperty& rgb) {
+RGBProperty operator*(Scalar num, const RGBProperty& rgb) {
     return rgb * num;
 }
 
-RGBProperty operator+(double num, const RGBProperty& rgb) {
+RGBProperty operator+(Scalar num, const RGBProperty& rgb) {
     return RGBProperty(rgb.r + num, rgb.g + num, rgb.b + num);
 }
 
-RGBProperty operator/(const RGBProperty& rgb, double val) {
+RGBProperty operator/(const RGBProperty& rgb, Scalar val) {
     return rgb * (1 / val);
 }
 
-RGBProperty Pow(const RGBProperty& rgb, double power) {
+RGBProperty Pow(const RGBProperty& rgb, Scalar power) {
     return RGBProperty(std::pow(rgb.r, power), std::pow(rgb.g, power), std::pow(rgb.b, power));
 }
 
 struct Properties {
-    Properties() = default;
+    enum Prop { Ka = 0, Ke, Kd, Ks, Ns, Tr, Ni, Illum, kPropCount };
+
+    Properties() {
+        arr_[Ni] = RGBProperty{1, 1, 1};
+    }
     Properties(RGBProperty ka, RGBProperty ke, RGBProperty kd, RGBProperty ks, RGBProperty ns,
                RGBProperty tr, RGBProperty ni, RGBProperty illum)
-        : ka(ka), ke(ke), kd(kd), ks(ks), ns(ns), tr(tr), ni(ni), illum(illum) {
+        : arr_{ka, ke, kd, ks, ns, tr, ni, illum} {
     }
 
-    RGBProperty& GetProperty(const std::string& property) {
-        if (property == "Ka") {
-            return ka;
-        }
-        if (property == "Ke") {
-            return ke;
-        }
-        if (property == "Kd") {
-            return kd;
-        }
-        if (property == "Ks") {
-            return ks;
-        }
-        if (property == "Ns") {
-            return ns;
-        }
-        if (property == "Tr") {
-            return tr;
+    // All names except "illum" are two characters and are told apart by the
+    // second one (plus the first for Ks/Ns), so lookup is a couple of
+    // character compares instead of a chain of string equality tests.
+    static Prop ParseName(std::string_view property) {
+        if (property.size() != 2) {
+            return Illum;
         }
-        if (property == "Ni") {
-            return ni;
-        }
-        if (property == "illum") {
-            return illum;
+        switch (property[1]) {
+            case 'a':
+                return Ka;
+            case 'e':
+                return Ke;
+            case 'd':
+                return Kd;
+            case 's':
+                return (property[0] == 'K') ? Ks : Ns;
+            case 'r':
+                return Tr;
+            case 'i':
+                return Ni;
+            default:
+                return Illum;
         }
-        return illum;
     }
+
+    RGBProperty& GetProperty(std::string_view property) {
+        return arr_[ParseName(property)];
+    }
+
     // Ka/Ke - the ambient colors
     // Kd - the diffuse color
     // Ks - the specular color
@@ -154,7 +193,32 @@ struct Properties {
     // Ni - optical density
     // illum нужно обрабатывать следующим образом - если значение > 2, то необходимо
     // также посчитать отраженный и преломленный лучи, иначе нет.
-    RGBProperty ka, ke, kd, ks, ns, tr{0, 0, 0}, ni{1, 1, 1}, illum;
+    const RGBProperty& ka() const {
+        return arr_[Ka];
+    }
+    const RGBProperty& ke() const {
+        return arr_[Ke];
+    }
+    const RGBProperty& kd() const {
+        return arr_[Kd];
+    }
+    const RGBProperty& ks() const {
+        return arr_[Ks];
+    }
+    const RGBProperty& ns() const {
+        return arr_[Ns];
+    }
+    const RGBProperty& tr() const {
+        return arr_[Tr];
+    }
+    const RGBProperty& ni() const {
+        return arr_[Ni];
+    }
+    const RGBProperty& illum() const {
+        return arr_[Illum];
+    }
+
+    std::array<RGBProperty, kPropCount> arr_{};
 };
 
 struct Vertex {
@@ -181,41 +245,42 @@ public:
                     const Vertex& v3)
         : type_(type), properties_(properties), v1_(v1), v2_(v2), v3_(v3) {
         assert(type == ObjType::Triangle);
+        PrecomputeTriangle();
     }
 
-    explicit Object(ObjType type, Properties& properties, const Vec3& center, double radius)
+    explicit Object(ObjType type, Properties& properties, const Vec3& center, Scalar radius)
         : type_(type), properties_(properties), center_(center), radius_(radius) {
         assert(type == ObjType::Sphere);
     }
 
     RGBProperty Ka() const {
-        return properties_.ka;
+        return properties_.ka();
     }
     RGBProperty Ke() const {
-        return properties_.ke;
+        return properties_.ke();
     }
     RGBProperty Kd() const {
-        return properties_.kd;
+        return properties_.kd();
     }
     RGBProperty Ks() const {
-        return properties_.ks;
+        return properties_.ks();
     }
     RGBProperty Ns() const {
-        return properties_.ns;
+        return properties_.ns();
     }
     RGBProperty Tr() const {
-        return properties_.tr;
+        return properties_.tr();
     }
     RGBProperty Ni() const {
-        return properties_.ni;
+        return properties_.ni();
     }
     RGBProperty Illum() const {
-        return properties_.illum;
+        return properties_.illum();
     }
     ObjType Type() const {
         return type_;
     }
-    double Radius() const {
+    Scalar Radius() const {
         return radius_;
     }
     const Vec3& Center() const {
@@ -244,22 +309,305 @@ public:
         return v3_;
     }
 
+    // Triangle-only caches filled once at construction: the unit geometric
+    // normal, the two edges from v1 and the barycentric dot products, so the
+    // per-ray tests do not redo the cross products.
+    const Vec3& Normal() const {
+        return normal_;
+    }
+    const Vec3& EdgeU() const {
+        return edge_u_;
+    }
+    const Vec3& EdgeV() const {
+        return edge_v_;
+    }
+    Scalar UU() const {
+        return uu_;
+    }
+    Scalar VV() const {
+        return vv_;
+    }
+    Scalar UV() const {
+        return uv_;
+    }
+    Scalar InvDenom() const {
+        return inv_denom_;
+    }
+
 private:
+    void PrecomputeTriangle() {
+        edge_u_ = v2_.vertex - v1_.vertex;
+        edge_v_ = v3_.vertex - v1_.vertex;
+        normal_ = VecProd(edge_u_, edge_v_);
+
+        uu_ = edge_u_ * edge_u_;
+        vv_ = edge_v_ * edge_v_;
+        uv_ = edge_u_ * edge_v_;
+
+        // |edge_u x edge_v|^2 == uu * vv - uv^2; zero for degenerate
+        // triangles, which then fail every intersection test.
+        Scalar denom = normal_ * normal_;
+        if (denom != 0) {
+            inv_denom_ = 1 / denom;
+            normal_ = normal_ * (1 / std::sqrt(denom));
+        }
+    }
+
     ObjType type_ = ObjType::None;
     Properties properties_{};
     Vertex v1_{}, v2_{}, v3_{};
     Vec3 center_{};
-    double radius_ = 0;
+    Scalar radius_ = 0;
+
+    Vec3 normal_{}, edge_u_{}, edge_v_{};
+    Scalar uu_ = 0, vv_ = 0, uv_ = 0, inv_denom_ = 0;
+};
+
+const Scalar kMaxDistance = std::numeric_limits<Scalar>::max();
+
+struct AABB {
+    Vec3 min{kMaxDistance, kMaxDistance, kMaxDistance};
+    Vec3 max{-kMaxDistance, -kMaxDistance, -kMaxDistance};
+
+    void Extend(const Vec3& point) {
+        for (int axis = 0; axis < 3; ++axis) {
+            min[axis] = std::min(min[axis], point[axis]);
+            max[axis] = std::max(max[axis], point[axis]);
+        }
+    }
+
+    void Extend(const AABB& other) {
+        Extend(other.min);
+        Extend(other.max);
+    }
+
+    Vec3 Center() const {
+        return 0.5 * (min + max);
+    }
+
+    Scalar SurfaceArea() const {
+        if (min.x > max.x) {
+            return 0;
+        }
+        Vec3 extent = max - min;
+        return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    int LongestAxis() const {
+        Vec3 extent = max - min;
+        if (extent.x >= extent.y && extent.x >= extent.z) {
+            return 0;
+        }
+        return (extent.y >= extent.z) ? 1 : 2;
+    }
+};
+
+AABB ObjectAABB(const Object& object) {
+    AABB bbox;
+    if (object.Type() == ObjType::Sphere) {
+        Vec3 radius{object.Radius(), object.Radius(), object.Radius()};
+        bbox.Extend(object.Center() - radius);
+        bbox.Extend(object.Center() + radius);
+    } else {
+        bbox.Extend(object(0).vertex);
+        bbox.Extend(object(1).vertex);
+        bbox.Extend(object(2).vertex);
+    }
+    return bbox;
+}
+
+// SAH-built bounding volume hierarchy: the tree is built once per scene and
+// traversed in Trace instead of the old linear loop over every object.
+class BVH {
+public:
+    struct Node {
+        AABB bbox;
+        uint32_t left = 0, right = 0;
+        uint32_t first_prim = 0, prim_count = 0;
+    };
+
+    void Build(const std::vector<Object>& objects) {
+        nodes_.clear();
+        prim_indices_.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            prim_indices_[i] = i;
+        }
+        if (objects.empty()) {
+            return;
+        }
+
+        std::vector<AABB> bboxes(objects.size());
+        std::vector<Vec3> centers(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            bboxes[i] = ObjectAABB(objects[i]);
+            centers[i] = bboxes[i].Center();
+        }
+
+        nodes_.reserve(2 * objects.size());
+        BuildNode(0, objects.size(), bboxes, centers);
+    }
+
+    const std::vector<Node>& Nodes() const {
+        return nodes_;
+    }
+
+    const std::vector<uint32_t>& PrimIndices() const {
+        return prim_indices_;
+    }
+
+private:
+    static const uint32_t kLeafSize = 2;
+    static const int kBinCount = 12;
+
+    uint32_t BuildNode(uint32_t first, uint32_t count, const std::vector<AABB>& bboxes,
+                       const std::vector<Vec3>& centers) {
+        assert(count > 0);
+        uint32_t index = nodes_.size();
+        nodes_.emplace_back();
+
+        AABB bbox, centroid_bounds;
+        for (uint32_t i = first; i < first + count; ++i) {
+            bbox.Extend(bboxes[prim_indices_[i]]);
+            centroid_bounds.Extend(centers[prim_indices_[i]]);
+        }
+        nodes_[index].bbox = bbox;
+
+        int axis = centroid_bounds.LongestAxis();
+        Scalar extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+        if (count <= kLeafSize || extent == 0) {
+            nodes_[index].first_prim = first;
+            nodes_[index].prim_count = count;
+            return index;
+        }
+
+        // Binned SAH: cost = 1 + (SA_L / SA_P) * N_L + (SA_R / SA_P) * N_R
+        AABB bin_bounds[kBinCount];
+        uint32_t bin_counts[kBinCount] = {};
+        for (uint32_t i = first; i < first + count; ++i) {
+            int bin = FindBin(centers[prim_indices_[i]][axis], centroid_bounds.min[axis], extent);
+            bin_bounds[bin].Extend(bboxes[prim_indices_[i]]);
+            ++bin_counts[bin];
+        }
+
+        Scalar right_area[kBinCount] = {};
+        uint32_t right_counts[kBinCount] = {};
+        AABB suffix;
+        uint32_t suffix_count = 0;
+        for (int bin = kBinCount - 1; bin > 0; --bin) {
+            suffix.Extend(bin_bounds[bin]);
+            suffix_count += bin_counts[bin];
+            right_area[bin] = suffix.SurfaceArea();
+            right_counts[bin] = suffix_count;
+        }
+
+        Scalar parent_area = bbox.SurfaceArea();
+        Scalar best_cost = kMaxDistance;
+        int best_split = -1;
+        AABB prefix;
+        uint32_t prefix_count = 0;
+        for (int bin = 1; bin < kBinCount; ++bin) {
+            prefix.Extend(bin_bounds[bin - 1]);
+            prefix_count += bin_counts[bin - 1];
+            if (prefix_count == 0 || right_counts[bin] == 0) {
+                continue;
+            }
+            Scalar cost = 1 + (prefix.SurfaceArea() * prefix_count +
+                               right_area[bin] * right_counts[bin]) /
+                                  parent_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = bin;
+            }
+        }
+
+        if (best_split == -1 || best_cost >= count) {
+            nodes_[index].first_prim = first;
+            nodes_[index].prim_count = count;
+            return index;
+        }
+
+        auto middle = std::partition(
+            prim_indices_.begin() + first, prim_indices_.begin() + first + count,
+            [&](uint32_t prim) {
+                return FindBin(centers[prim][axis], centroid_bounds.min[axis], extent) < best_split;
+            });
+        uint32_t left_count = middle - (prim_indices_.begin() + first);
+        assert(left_count > 0 && left_count < count);
+
+        uint32_t left = BuildNode(first, left_count, bboxes, centers);
+        uint32_t right = BuildNode(first + left_count, count - left_count, bboxes, centers);
+        nodes_[index].left = left;
+        nodes_[index].right = right;
+        return index;
+    }
+
+    static int FindBin(Scalar center, Scalar bounds_min, Scalar extent) {
+        int bin = static_cast<int>(kBinCount * (center - bounds_min) / extent);
+        return std::min(bin, kBinCount - 1);
+    }
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> prim_indices_;
+};
+
+// Only the fields the intersection tests actually read, copied out of
+// Object into BVH primitive order. A full Object carries the material and
+// per-vertex data as well, so leaf tests through it drag hundreds of bytes
+// through the cache; these records are a fraction of that and adjacent
+// leaf primitives sit next to each other in memory.
+struct alignas(16) HotPrim {
+    Vec3 v1{};  // triangle corner, or sphere center
+    Vec3 edge_u{}, edge_v{};
+    Vec3 normal{};
+    Scalar radius = 0;
+    uint32_t object_index = 0;
+    ObjType type = ObjType::None;
 };
 
 class ObjectSet {
 public:
     ObjectSet() = default;
 
+    void Reserve(size_t count) {
+        objects_.reserve(count);
+    }
+
     void InsertObject(const Object& object) {
         objects_.emplace_back(object);
     }
 
+    void Build() {
+        bvh_.Build(objects_);
+
+        hot_prims_.clear();
+        hot_prims_.reserve(bvh_.PrimIndices().size());
+        for (uint32_t index : bvh_.PrimIndices()) {
+            const Object& object = objects_[index];
+            HotPrim prim;
+            prim.object_index = index;
+            prim.type = object.Type();
+            if (object.Type() == ObjType::Sphere) {
+                prim.v1 = object.Center();
+                prim.radius = object.Radius();
+            } else {
+                prim.v1 = object.V1().vertex;
+                prim.edge_u = object.EdgeU();
+                prim.edge_v = object.EdgeV();
+                prim.normal = object.Normal();
+            }
+            hot_prims_.push_back(prim);
+        }
+    }
+
+    // Indexed by BVH leaf ranges (same order as BVH::PrimIndices).
+    const std::vector<HotPrim>& HotPrims() const {
+        return hot_prims_;
+    }
+
+    const BVH& Bvh() const {
+        return bvh_;
+    }
+
     const Object& operator[](size_t index) const {
         assert(index < objects_.size());
         return objects_[index];
@@ -271,6 +619,8 @@ public:
 
 private:
     std::vector<Object> objects_;
+    std::vector<HotPrim> hot_prims_;
+    BVH bvh_;
 };
 
 #endif  // SHAD_CPP0_OBJECTS_CLASS_H
@@ -1,54 +1,110 @@
 #ifndef SHAD_CPP0_PARSING_H
 #define SHAD_CPP0_PARSING_H
 
+#include <algorithm>
+#include <array>
 #include <cassert>
-#include <fstream>
+#include <charconv>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <objects_class.h>
-#include <iostream>
 #include <unordered_map>
 #include <cctype>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The whole scene file is mapped into memory once; tokens are string_views
+// into the mapping and numbers go through std::from_chars, so parsing never
+// copies characters or allocates per token (iostream extraction did both).
 class FileStream {
 public:
     FileStream(const std::string& filename) {
-        input_.open(filename);
-        assert(input_);
+        int fd = open(filename.c_str(), O_RDONLY);
+        assert(fd >= 0);
+        struct stat file_stat;
+        int status = fstat(fd, &file_stat);
+        assert(status == 0);
+        size_ = file_stat.st_size;
+        if (size_ > 0) {
+            data_ = static_cast<const char*>(mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0));
+            assert(data_ != MAP_FAILED);
+        }
+        close(fd);
+        cur_ = data_;
+        end_ = data_ + size_;
     }
 
-    FileStream& operator>>(std::string& str) {
-        Skip();
-        if (input_.eof()) {
-            return *this;
+    FileStream(const FileStream&) = delete;
+    FileStream& operator=(const FileStream&) = delete;
+
+    ~FileStream() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
         }
-        input_ >> str;
-        return *this;
     }
 
     bool Eof() {
         Skip();
-        return input_.eof();
+        return cur_ == end_;
     }
 
-    std::ifstream input_;
+    std::string_view NextToken() {
+        Skip();
+        const char* begin = cur_;
+        while (cur_ < end_ && !isspace(static_cast<unsigned char>(*cur_))) {
+            ++cur_;
+        }
+        return {begin, static_cast<size_t>(cur_ - begin)};
+    }
+
+    Scalar NextScalar() {
+        Skip();
+        Scalar value = 0;
+        auto result = std::from_chars(cur_, end_, value);
+        assert(result.ec == std::errc());
+        cur_ = result.ptr;
+        return value;
+    }
+
+    std::string_view Contents() const {
+        return {data_, size_};
+    }
+
+    // Everything up to (not including) the next newline; used for face lines.
+    std::string_view RestOfLine() {
+        const char* begin = cur_;
+        const char* newline = static_cast<const char*>(memchr(cur_, '\n', end_ - cur_));
+        const char* stop = (newline != nullptr) ? newline : end_;
+        cur_ = (newline != nullptr) ? newline + 1 : end_;
+        return {begin, static_cast<size_t>(stop - begin)};
+    }
 
 private:
     void Skip() {
-        char symbol = 0;
-        symbol = input_.get();
-        while (isspace(symbol) || symbol == '#') {
-            if (symbol == '#') {
-                std::string buf;
-                std::getline(input_, buf);
+        while (cur_ < end_) {
+            if (isspace(static_cast<unsigned char>(*cur_))) {
+                ++cur_;
+                continue;
             }
-            symbol = input_.get();
-        }
-        if (input_.eof()) {
-            return;
+            if (*cur_ == '#') {
+                const char* newline =
+                    static_cast<const char*>(memchr(cur_, '\n', end_ - cur_));
+                cur_ = (newline != nullptr) ? newline + 1 : end_;
+                continue;
+            }
+            break;
         }
-        input_.unget();
     }
+
+    const char* data_ = nullptr;
+    const char* cur_ = nullptr;
+    const char* end_ = nullptr;
+    size_t size_ = 0;
 };
 
 std::unordered_map<std::string, Properties> ParseMtlFile(FileStream& mtlfile);
@@ -62,38 +118,37 @@ void GetObjects(const std::string& filename, ObjectSet& objectset,
     FileStream objfile(filename);
 
     std::string mtl_filename = filename.substr(0, filename.find_last_of("/") + 1);
-    std::string str;
-    objfile >> str;
+    std::string_view str = objfile.NextToken();
     assert(str == "mtllib");
-    objfile >> str;
-    mtl_filename += str;
+    mtl_filename += objfile.NextToken();
     FileStream mtlfile(mtl_filename);
 
     std::unordered_map<std::string, Properties> materials;
     materials = ParseMtlFile(mtlfile);
 
     ParseObjFile(objfile, objectset, materials, sources);
+    objectset.Build();
 }
-int ReadNumber(const std::string& str, size_t* idx) {
+int ReadNumber(std::string_view str, size_t* idx) {
     int number = 0, sign = 1;
-    while (*idx < str.size() && isspace(str[*idx])) {
+    while (*idx < str.size() && isspace(static_cast<unsigned char>(str[*idx]))) {
         *idx += 1;
     }
     if (*idx < str.size() && str[*idx] == '-') {
         sign = -1;
         *idx += 1;
     }
-    while (*idx < str.size() && isdigit(str[*idx])) {
+    while (*idx < str.size() && isdigit(static_cast<unsigned char>(str[*idx]))) {
         number = number * 10 + str[*idx] - '0';
         *idx += 1;
     }
-    while (*idx < str.size() && isspace(str[*idx])) {
+    while (*idx < str.size() && isspace(static_cast<unsigned char>(str[*idx]))) {
         *idx += 1;
     }
     return number * sign;
 }
 
-void ReadVertices(const std::string& str, std::vector<Vertex>& vertices,
+void ReadVertices(std::string_view str, std::vector<Vertex>& vertices,
                   const std::vector<Vec3>& veccoord, const std::vector<Vec3>& normals) {
     for (size_t i = 0; i < str.size();) {
         int vertex = 0, normal = 0;
@@ -130,95 +185,139 @@ void InsertTriangles(ObjectSet& objset, const std::vector<Vertex>& vertices,
     }
 }
 
+struct ObjCounts {
+    size_t vertices = 0, normals = 0, faces = 0, spheres = 0;
+};
+
+// One scan over the mapped file to size the vectors before parsing, so the
+// parse loop itself never reallocates.
+ObjCounts CountObjEntries(std::string_view contents) {
+    ObjCounts counts;
+    size_t pos = 0;
+    while (pos < contents.size()) {
+        while (pos < contents.size() && (contents[pos] == ' ' || contents[pos] == '\t')) {
+            ++pos;
+        }
+        if (pos < contents.size()) {
+            char first = contents[pos];
+            char second = (pos + 1 < contents.size()) ? contents[pos + 1] : '\n';
+            if (first == 'v' && isspace(static_cast<unsigned char>(second))) {
+                ++counts.vertices;
+            } else if (first == 'v' && second == 'n') {
+                ++counts.normals;
+            } else if (first == 'f' && isspace(static_cast<unsigned char>(second))) {
+                ++counts.faces;
+            } else if (first == 'S' && isspace(static_cast<unsigned char>(second))) {
+                ++counts.spheres;
+            }
+        }
+        const char* newline = static_cast<const char*>(
+            memchr(contents.data() + pos, '\n', contents.size() - pos));
+        if (newline == nullptr) {
+            break;
+        }
+        pos = newline - contents.data() + 1;
+    }
+    return counts;
+}
+
 void ParseObjFile(FileStream& file, ObjectSet& objectset,
                   std::unordered_map<std::string, Properties>& materials,
                   std::vector<LightSource>& sources) {
-    std::string str, material;
+    std::string material;
     std::vector<Vec3> vertices;
     std::vector<Vec3> normals;
+    // Reused across face lines so its capacity is allocated once, not per 'f'.
+    std::vector<Vertex> objvertices;
     vertices.emplace_back();
     normals.emplace_back();
 
+    // A face line with more than three vertices fans into extra triangles,
+    // so double the face count as a safe overestimate.
+    ObjCounts counts = CountObjEntries(file.Contents());
+    vertices.reserve(counts.vertices + 1);
+    normals.reserve(counts.normals + 1);
+    objectset.Reserve(2 * counts.faces + counts.spheres);
+
     while (!file.Eof()) {
-        file >> str;
+        std::string_view str = file.NextToken();
         if (str == "v") {
-            double x, y, z;
-            file.input_ >> x >> y >> z;
+            Scalar x = file.NextScalar();
+            Scalar y = file.NextScalar();
+            Scalar z = file.NextScalar();
             vertices.emplace_back(x, y, z);
             continue;
         }
         if (str == "usemtl") {
-            file.input_ >> material;
+            material = file.NextToken();
             continue;
         }
         if (str == "f") {
-            std::vector<Vertex> objvertices;
-            std::string strline;
-            std::getline(file.input_, strline);
-            ReadVertices(strline, objvertices, vertices, normals);
+            objvertices.clear();
+            ReadVertices(file.RestOfLine(), objvertices, vertices, normals);
             assert(objvertices.size() > 2);
             InsertTriangles(objectset, objvertices, materials[material]);
             continue;
         }
         if (str == "vn") {
-            double x, y, z;
-            file.input_ >> x >> y >> z;
+            Scalar x = file.NextScalar();
+            Scalar y = file.NextScalar();
+            Scalar z = file.NextScalar();
             normals.emplace_back(x, y, z);
             continue;
         }
         if (str == "S") {
-            double x, y, z;
-            file.input_ >> x >> y >> z;
-            double radius = 0;
-            file.input_ >> radius;
+            Scalar x = file.NextScalar();
+            Scalar y = file.NextScalar();
+            Scalar z = file.NextScalar();
+            Scalar radius = file.NextScalar();
             objectset.InsertObject(
                 Object{ObjType::Sphere, materials[material], Vec3{x, y, z}, radius});
             continue;
         }
         if (str == "P") {
-            double x, y, z;
-            file.input_ >> x >> y >> z;
-            double r, g, b;
-            file.input_ >> r >> g >> b;
+            Scalar x = file.NextScalar();
+            Scalar y = file.NextScalar();
+            Scalar z = file.NextScalar();
+            Scalar r = file.NextScalar();
+            Scalar g = file.NextScalar();
+            Scalar b = file.NextScalar();
             sources.emplace_back(LightSource{Vec3{x, y, z}, RGBProperty{r, g, b}});
         }
     }
 }
 
+static constexpr std::array<std::string_view, 9> kKnownProperties{"Ka", "Ke", "Kd",    "Ks", "Ns",
+                                                                  "Tr", "Ni", "illum", "d"};
+
 std::unordered_map<std::string, Properties> ParseMtlFile(FileStream& mtlfile) {
     std::unordered_map<std::string, Properties> materials;
-    std::vector<std::string> to_check{"Ka", "Ke", "Kd", "Ks", "Ns", "Tr", "Ni", "illum", "d"};
 
-    std::string str, material_name;
-    mtlfile >> str;
+    std::string_view str = mtlfile.NextToken();
     assert(str == "newmtl");
     while (!mtlfile.Eof()) {
 
-        mtlfile >> material_name;
+        std::string material_name{mtlfile.NextToken()};
         Properties properties;
-        std::string property;
-        mtlfile >> property;
+        std::string_view property = mtlfile.NextToken();
 
         while (!mtlfile.Eof() && property != "newmtl") {
-            std::string value;
-            std::vector<double> values_rgb;
+            std::vector<Scalar> values_rgb;
 
-            mtlfile >> value;
-            while (isdigit(value[0])) {
-                values_rgb.push_back(std::stod(value));
+            std::string_view value = mtlfile.NextToken();
+            while (!value.empty() && isdigit(static_cast<unsigned char>(value[0]))) {
+                Scalar parsed = 0;
+                auto result = std::from_chars(value.data(), value.data() + value.size(), parsed);
+                assert(result.ec == std::errc());
+                values_rgb.push_back(parsed);
                 if (mtlfile.Eof()) {
                     break;
                 }
-                mtlfile >> value;
+                value = mtlfile.NextToken();
             }
 
-            bool found = false;
-            for (auto& prop : to_check) {
-                if (property == prop) {
-                    found = true;
-                    break;
-                }
-            }
+            bool found = std::find(kKnownProperties.begin(), kKnownProperties.end(), property) !=
+                         kKnownProperties.end();
 
             if (!found) {
                 property = value;
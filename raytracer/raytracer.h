@@ -13,7 +13,7 @@
 #include <iostream>
 #include <fstream>
 
-void MakeImage(Image& image, const std::vector<std::vector<RGBProperty>>& image_matrix);
+void MakeImage(Image& image, const std::vector<RGBProperty>& image_matrix);
 
 Image Render(const std::string& filename, const CameraOptions& camera_options,
              const RenderOptions& render_options) {
@@ -24,20 +24,58 @@ Image Render(const std::string& filename, const CameraOptions& camera_options,
     int screen_width = camera_options.screen_width;
     int screen_height = camera_options.screen_height;
 
-    std::vector<std::vector<RGBProperty>> image_matrix(screen_height,
-                                                       std::vector<RGBProperty>(screen_width));
+    // One contiguous row-major buffer: pixel (h, w) lives at h * screen_width + w.
+    std::vector<RGBProperty> image_matrix(static_cast<size_t>(screen_height) * screen_width);
 
-    std::vector<std::vector<double>> to_world_matrix(3, std::vector<double>(3, 0));
+    ToWorldMatrix to_world_matrix;
     MakeToWorldMatrix(camera_options, to_world_matrix);
 
-    for (int pix_height = 0; pix_height < screen_height; ++pix_height) {
-        for (int pix_width = 0; pix_width < screen_width; ++pix_width) {
-
-            Ray ray =
-                MakeCameraRay(camera_options, pix_height, pix_width, screen_height, screen_width);
+    CameraRaySetup ray_setup(camera_options, screen_height, screen_width);
 
-            ray = CameraToWorld(ray, camera_options, to_world_matrix);
-            image_matrix[pix_height][pix_width] = GetI(&ray, objects, sources, render_options, 1);
+    // Primary rays go through the BVH eight at a time; shading and secondary
+    // rays stay scalar per lane. Rows are independent, so they are handed
+    // out to threads dynamically (shadow/reflection cost varies per row).
+    // On CPUs without AVX2+FMA every lane takes the scalar pipeline instead.
+    const bool use_packets = HasAvx2();
+#pragma omp parallel for schedule(dynamic, 8)
+    for (int pix_height = 0; pix_height < screen_height; ++pix_height) {
+        for (int pix_width = 0; pix_width < screen_width; pix_width += 8) {
+            int lanes = std::min(8, screen_width - pix_width);
+
+            Ray rays[8];
+            for (int lane = 0; lane < lanes; ++lane) {
+                Ray ray = MakeCameraRay(ray_setup, pix_height, pix_width + lane);
+                rays[lane] = CameraToWorld(ray, camera_options, to_world_matrix);
+            }
+            for (int lane = lanes; lane < 8; ++lane) {
+                rays[lane] = rays[lanes - 1];
+            }
+
+            if (!use_packets) {
+                for (int lane = 0; lane < lanes; ++lane) {
+                    image_matrix[pix_height * static_cast<size_t>(screen_width) + pix_width +
+                                 lane] = GetI(&rays[lane], objects, sources, render_options, 1);
+                }
+                continue;
+            }
+
+            RayPacket8 packet(rays);
+            int hit_index[8];
+            Scalar hit_distance[8];
+            TracePacket8(packet, objects, hit_index, hit_distance);
+
+            for (int lane = 0; lane < 8; ++lane) {
+                if (hit_index[lane] >= 0) {
+                    rays[lane].distance = hit_distance[lane];
+                }
+            }
+
+            RGBProperty pixels[8];
+            ShadePacket8(rays, hit_index, lanes, objects, sources, render_options, pixels);
+            for (int lane = 0; lane < lanes; ++lane) {
+                image_matrix[pix_height * static_cast<size_t>(screen_width) + pix_width + lane] =
+                    pixels[lane];
+            }
         }
     }
 
@@ -46,14 +84,11 @@ Image Render(const std::string& filename, const CameraOptions& camera_options,
     return image;
 }
 
-void MakeImage(Image& image, const std::vector<std::vector<RGBProperty>>& image_matrix) {
-    double max_pix = image_matrix[0][0].r;
+void MakeImage(Image& image, const std::vector<RGBProperty>& image_matrix) {
+    Scalar max_pix = image_matrix[0].r;
 
-    for (int i = 0; i < image.Height(); ++i) {
-        for (int k = 0; k < image.Width(); ++k) {
-            const RGBProperty& pixel = image_matrix[i][k];
-            max_pix = std::max(max_pix, std::max(pixel.r, std::max(pixel.g, pixel.b)));
-        }
+    for (const RGBProperty& pixel : image_matrix) {
+        max_pix = std::max(max_pix, std::max(pixel.r, std::max(pixel.g, pixel.b)));
     }
 
     if (fabs(max_pix) < kComparisonThreshold) {
@@ -62,18 +97,18 @@ void MakeImage(Image& image, const std::vector<std::vector<RGBProperty>>& image_
 
     for (int height = 0; height < image.Height(); ++height) {
         for (int width = 0; width < image.Width(); ++width) {
-            RGBProperty pixel = image_matrix[height][width];
+            RGBProperty pixel = image_matrix[height * static_cast<size_t>(image.Width()) + width];
 
             pixel = pixel * (1.0 + pixel / (max_pix * max_pix)) / (1.0 + pixel);
-            pixel = Pow(pixel, 1 / 2.2);
+            pixel = Pow(pixel, 1 / 2.2f);
             pixel = pixel * 255;
 
-            assert(pixel.r < 255 + kComparisonThreshold && pixel.g < 255 + kComparisonThreshold &&
-                   pixel.b < 255 + kComparisonThreshold);
+            // In single precision the tone map can land a hair above 1 for
+            // the brightest pixel, so clamp instead of asserting the range.
             RGB rgb;
-            rgb.r = static_cast<int>(pixel.r);
-            rgb.g = static_cast<int>(pixel.g);
-            rgb.b = static_cast<int>(pixel.b);
+            rgb.r = static_cast<int>(std::min(pixel.r, Scalar(255)));
+            rgb.g = static_cast<int>(std::min(pixel.g, Scalar(255)));
+            rgb.b = static_cast<int>(std::min(pixel.b, Scalar(255)));
             image.SetPixel(rgb, height, width);
         }
     }
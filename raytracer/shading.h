@@ -10,14 +10,33 @@
 
 RGBProperty Diffuse(const Object& object, const Vec3& to_light, const RGBProperty& intensity,
                     const Vec3& normal) {
-    RGBProperty rgb = object.Kd() * intensity * std::max(0.0, normal * to_light);
+    RGBProperty rgb = object.Kd() * intensity * std::max(Scalar(0), normal * to_light);
     return rgb;
 }
 
+// Phong exponents in .mtl files are almost always small integers, for which
+// repeated squaring beats the ~80-cycle libm pow; anything else falls back.
+Scalar FastPow(Scalar base, Scalar exponent) {
+    int whole = static_cast<int>(exponent);
+    if (exponent != static_cast<Scalar>(whole) || whole < 0 || whole > 128) {
+        return std::pow(base, exponent);
+    }
+    Scalar result = 1;
+    Scalar square = base;
+    while (whole > 0) {
+        if (whole & 1) {
+            result *= square;
+        }
+        square *= square;
+        whole >>= 1;
+    }
+    return result;
+}
+
 RGBProperty Specular(const Object& object, const Vec3& vec_e, const Vec3& to_light,
                      const RGBProperty& intensity, const Vec3& normal) {
     Vec3 vec_r = (2.0 * (normal * to_light) * normal - to_light);
-    return object.Ks() * intensity * std::pow(vec_e * vec_r, object.Ns().r);
+    return object.Ks() * intensity * FastPow(vec_e * vec_r, object.Ns().r);
 }
 
 Vec3 ComputeNormal(const Ray& ray, const Vec3& hit_point, const Object& object) {
@@ -26,16 +45,15 @@ Vec3 ComputeNormal(const Ray& ray, const Vec3& hit_point, const Object& object)
         if (object(0).defined_normal) {
             normal = InterpolateNormal(object, hit_point);
         } else {
-            normal =
-                VecProd(object(1).vertex - object(0).vertex, object(2).vertex - object(0).vertex);
-            normal.Normalize();
+            // Unit geometric normal cached by PrecomputeTriangle at load time.
+            normal = object.Normal();
         }
     } else {
         normal = (hit_point - object.Center()).Normalize();
     }
 
     if (ray.direction * normal > 0 + kComparisonThreshold) {
-        normal = -1 * normal;
+        normal = -normal;
     }
 
     return normal;
@@ -59,8 +77,7 @@ RGBProperty GetI(Ray* ray, const ObjectSet& objects, const std::vector<LightSour
     return pixel;
 }
 
-Ray Reflected(const Ray& ray, const Vec3& normal, const Vec3& hit_point) {
-    Vec3 falling = -1 * ray.direction;
+Ray Reflected(const Vec3& falling, const Vec3& normal, const Vec3& hit_point) {
     Vec3 direction = 2 * (falling * normal) * normal - falling;
 
     return Ray(hit_point, direction);
@@ -90,17 +107,23 @@ RGBProperty Shade(const Ray& ray, const Object& object, const ObjectSet& objects
     RGBProperty ip{};
     ip = object.Ka() + object.Ke();
 
-    for (const auto& source : sources) {
-        if (VisibleLight(source, hit_point, objects, normal)) {
-            Vec3 to_light = Vec3(source.place - hit_point).Normalize();
-            ip += Diffuse(object, to_light, source.intensity, normal) +
-                  Specular(object, -1 * ray.direction, to_light, source.intensity, normal);
+    Vec3 neg_dir = -ray.direction;
+    for (size_t first = 0; first < sources.size(); first += 8) {
+        uint32_t visible = VisibleLights8(hit_point, normal, sources, first, objects);
+        size_t block = std::min<size_t>(8, sources.size() - first);
+        for (size_t i = 0; i < block; ++i) {
+            if (visible & (uint32_t(1) << i)) {
+                const LightSource& source = sources[first + i];
+                Vec3 to_light = Vec3(source.place - hit_point).Normalize();
+                ip += Diffuse(object, to_light, source.intensity, normal) +
+                      Specular(object, neg_dir, to_light, source.intensity, normal);
+            }
         }
     }
 
     if (object.Illum().r > 2) {
         // reflection
-        Ray reflected = Reflected(ray, normal, hit_point);
+        Ray reflected = Reflected(neg_dir, normal, hit_point);
         reflected.origin = reflected.origin + kEpsilon * reflected.direction;
 
         RGBProperty intensity = GetI(&reflected, objects, sources, render_options, depth + 1);
@@ -109,7 +132,7 @@ RGBProperty Shade(const Ray& ray, const Object& object, const ObjectSet& objects
         Vec3 vec_to_light = Vec3(light_place - hit_point).Normalize();
 
         ip += Diffuse(object, vec_to_light, intensity, normal) +
-              Specular(object, -1 * ray.direction, vec_to_light, intensity, normal);
+              Specular(object, neg_dir, vec_to_light, intensity, normal);
         // refraction
         if (object.Tr().r != 0) {
             assert(object.Ni().r != 0);
@@ -122,4 +145,71 @@ RGBProperty Shade(const Ray& ray, const Object& object, const ObjectSet& objects
 
     return ip;
 }
+
+// Direct lighting for a whole primary packet. Coherent primary rays usually
+// land on the same object; when they do and the material spawns no secondary
+// rays, each light's eight shadow rays are traced as one packet instead of
+// eight separate BVH walks. Divergent packets fall back to scalar Shade.
+void ShadePacket8(const Ray rays[8], const int hit_index[8], int lanes, const ObjectSet& objects,
+                  const std::vector<LightSource>& sources, const RenderOptions& render_options,
+                  RGBProperty pixels[8]) {
+    for (int lane = 0; lane < lanes; ++lane) {
+        pixels[lane] = RGBProperty{};
+    }
+    if (render_options.depth < 1) {
+        return;
+    }
+
+    bool uniform = hit_index[0] >= 0;
+    for (int lane = 1; lane < 8; ++lane) {
+        uniform = uniform && hit_index[lane] == hit_index[0];
+    }
+    if (!uniform || objects[hit_index[0]].Illum().r > 2) {
+        for (int lane = 0; lane < lanes; ++lane) {
+            if (hit_index[lane] >= 0) {
+                pixels[lane] = Shade(rays[lane], objects[hit_index[lane]], objects, sources,
+                                     render_options, 1);
+            }
+        }
+        return;
+    }
+
+    const Object& object = objects[hit_index[0]];
+    Vec3 hit_points[8], normals[8];
+    for (int lane = 0; lane < 8; ++lane) {
+        hit_points[lane] = rays[lane].origin + rays[lane].distance * rays[lane].direction;
+        normals[lane] = ComputeNormal(rays[lane], hit_points[lane], object);
+        pixels[lane] = object.Ka() + object.Ke();
+    }
+
+    for (const auto& source : sources) {
+        Ray shadow_rays[8];
+        Scalar light_distances[8];
+        bool facing[8];
+        for (int lane = 0; lane < 8; ++lane) {
+            Vec3 to_light = Vec3(source.place - hit_points[lane]);
+            facing[lane] = normals[lane] * to_light >= 0 - kComparisonThreshold;
+            light_distances[lane] = to_light.Length();
+            to_light.Normalize();
+            shadow_rays[lane] =
+                Ray(hit_points[lane] + OriginBias(hit_points[lane]) * to_light, to_light);
+        }
+
+        RayPacket8 shadow_packet(shadow_rays);
+        int occluder[8];
+        Scalar occluder_distance[8];
+        TracePacket8(shadow_packet, objects, occluder, occluder_distance);
+
+        for (int lane = 0; lane < 8; ++lane) {
+            bool occluded = occluder[lane] >= 0 && occluder_distance[lane] <
+                                                       light_distances[lane] - kComparisonThreshold;
+            if (facing[lane] && !occluded) {
+                Vec3 to_light = Vec3(source.place - hit_points[lane]).Normalize();
+                pixels[lane] += Diffuse(object, to_light, source.intensity, normals[lane]) +
+                                Specular(object, -rays[lane].direction, to_light,
+                                         source.intensity, normals[lane]);
+            }
+        }
+    }
+}
 #endif  // SHAD_CPP0_SHADING_H
@@ -1,5 +1,18 @@
 #include "bot.h"
-#include <random>
+#include <charconv>
+#include <string_view>
+
+// Packs the first eight bytes of a command into one integer so dispatch is a
+// single load and a jump table instead of a chain of string compares.
+// Commands shorter than eight bytes are zero-padded, and text cannot contain
+// '\0', so short commands collide with nothing; longer ones check the tail.
+static constexpr uint64_t PackCommand(std::string_view text) {
+    uint64_t packed = 0;
+    for (size_t i = 0; i < text.size() && i < sizeof(packed); ++i) {
+        packed |= static_cast<uint64_t>(static_cast<unsigned char>(text[i])) << (8 * i);
+    }
+    return packed;
+}
 
 void BotBase::Start() {
     while (!stop_status_) {
@@ -7,7 +20,7 @@ void BotBase::Start() {
             if (!client_.ReceiveMessage()) {
                 continue;
             }
-            auto messages = client_.GetMessages();
+            const auto& messages = client_.GetMessages();
             for (const auto& message : messages) {
                 ProcessMessage(message);
             }
@@ -22,64 +35,68 @@ void BotBase::Start() {
     }
 }
 
-void BotBase::ProcessMessage(std::shared_ptr<Message> message) {
-    switch (message->type) {
-        case kText:
-            ProcessTextMessage(message);
-        default:
-            return;
+void BotBase::ProcessMessage(const Message& message) {
+    // Only text messages are handled today; a direct test beats a switch
+    // that fell through into default and invites a missing-break bug when
+    // sticker handling is added.
+    if (message.type == kText) {
+        ProcessTextMessage(message);
     }
 }
 
-void Bot::ProcessTextMessage(std::shared_ptr<Message> message) {
-    auto text_message = std::static_pointer_cast<TextMessage>(message);
-    assert(text_message);
-
-    if (text_message->entities.size() != 1 || text_message->entities[0].type != "bot_command") {
+void Bot::ProcessTextMessage(const Message& message) {
+    if (message.entities.size() != 1 || message.entities[0].type != EntityType::kBotCommand) {
         return;
     }
-    if (static_cast<int>(text_message->text.size()) != text_message->entities[0].length) {
+    if (static_cast<int>(message.text.size()) != message.entities[0].length) {
         return;
     }
 
-    ProcessCommand(text_message);
+    ProcessCommand(message);
 }
 
-void Bot::ProcessCommand(std::shared_ptr<TextMessage> message) {
-    if (message->text == "/random") {
-        static std::mt19937 generator;
-        std::uniform_int_distribution random_number(0, 1000000);
+void Bot::ProcessCommand(const Message& message) {
+    switch (PackCommand(message.text)) {
+        case PackCommand("/random"): {
+            int number = random_number_(generator_);
+            char buffer[8];  // at most seven digits plus room to spare
+            auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
 
-        int number = random_number(generator);
-        std::vector<std::pair<std::string, std::string>> text;
-        text.emplace_back("text", std::to_string(number));
-        client_.SendTextMessage(message->chat.id, std::move(text));
-        return;
-    }
+            client_.SendTextMessage(message.chat.id,
+                                    std::string_view(buffer, end - buffer));
+            return;
+        }
 
-    if (message->text == "/weather") {
-        std::vector<std::pair<std::string, std::string>> text;
-        text.emplace_back("text", "Winter Is Coming");
-        client_.SendTextMessage(message->chat.id, std::move(text));
-        return;
-    }
+        case PackCommand("/weather"): {
+            // Exactly eight bytes, so any text sharing the prefix packs the
+            // same; reject longer strings here.
+            if (message.text.size() != 8) {
+                return;
+            }
+            client_.SendTextMessage(message.chat.id, "Winter Is Coming");
+            return;
+        }
 
-    if (message->text == "/styleguide") {
-        std::vector<std::pair<std::string, std::string>> text;
-        text.emplace_back("text",
-                          "В ресторане под названием \"Глобальные перемены\" раздраженный "
-                          "программист к названию каждого блюда в меню подписал слева букву k.");
-        client_.SendTextMessage(message->chat.id, std::move(text));
-        return;
-    }
+        case PackCommand("/styleguide"): {
+            if (message.text != "/styleguide") {
+                return;
+            }
+            constexpr std::string_view kStyleGuide =
+                "В ресторане под названием \"Глобальные перемены\" раздраженный "
+                "программист к названию каждого блюда в меню подписал слева букву k.";
+            client_.SendTextMessage(message.chat.id, kStyleGuide);
+            return;
+        }
 
-    if (message->text == "/stop") {
-        stop_status_ = true;
-        return;
-    }
+        case PackCommand("/stop"):
+            stop_status_ = true;
+            return;
 
-    if (message->text == "/crash") {
-        abort();
+        case PackCommand("/crash"):
+            abort();
+
+        default:
+            return;
     }
 }
 
@@ -3,6 +3,8 @@
 
 #include "client.h"
 
+#include <random>
+
 class BotBase {
 public:
     BotBase(const std::string& api_key, std::string filename = "offset.txt")
@@ -11,8 +13,8 @@ public:
     void Start();
 
 protected:
-    void ProcessMessage(std::shared_ptr<Message> message);
-    virtual void ProcessTextMessage(std::shared_ptr<Message> message) = 0;
+    void ProcessMessage(const Message& message);
+    virtual void ProcessTextMessage(const Message& message) = 0;
 
 protected:
     Client client_;
@@ -24,12 +26,17 @@ public:
     Bot(const std::string& api_key, std::string filename = "offset.txt")
         : BotBase(api_key, filename) {}
 
-    void ProcessTextMessage(std::shared_ptr<Message> message) override;
-    void ProcessCommand(std::shared_ptr<TextMessage> message);
+    void ProcessTextMessage(const Message& message) override;
+    void ProcessCommand(const Message& message);
 
 private:
     std::string api_key_;
     std::string offset_filename_;
+
+    // Per-bot generator: seeded once so restarts do not replay the same
+    // sequence, and owned by the instance so parallel bots never share state.
+    std::mt19937 generator_{std::random_device{}()};
+    std::uniform_int_distribution<int> random_number_{0, 1000000};
 };
 
 #endif  // SHAD_CPP0_BOT_H
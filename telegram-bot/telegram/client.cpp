@@ -1,19 +1,70 @@
 #include "client.h"
 
+#include <Poco/StreamCopier.h>
+
+#include <charconv>
+#include <cstdio>
 #include <exception>
 #include <utility>
-#include <sstream>
+#include <ostream>
+#include <streambuf>
+
+// std::ostream adapter that appends straight into a caller-owned string, so
+// stringify runs once and its output lands in a reusable buffer with no
+// stringstream copy on the way out.
+class StringOutputStream : private std::streambuf, public std::ostream {
+public:
+    explicit StringOutputStream(std::string* out) : std::ostream(this), out_(out) {
+    }
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        out_->append(data, size);
+        return size;
+    }
+    int overflow(int character) override {
+        out_->push_back(static_cast<char>(character));
+        return character;
+    }
+
+private:
+    std::string* out_;
+};
+
+// Integer query parameters are small; format them on the stack instead of
+// through std::to_string.
+static std::string FormatInt(int64_t value) {
+    char buffer[24];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, end);
+}
+
+// The first character splits the vocabulary; one full compare confirms.
+EntityType ParseEntityType(const std::string& name) {
+    switch (name.empty() ? '\0' : name[0]) {
+        case 'b':
+            return name == "bot_command" ? EntityType::kBotCommand : EntityType::kOther;
+        case 'm':
+            return name == "mention" ? EntityType::kMention : EntityType::kOther;
+        case 'u':
+            return name == "url" ? EntityType::kUrl : EntityType::kOther;
+        case 'h':
+            return name == "hashtag" ? EntityType::kHashtag : EntityType::kOther;
+        default:
+            return EntityType::kOther;
+    }
+}
 
 // todo Log file for errors
 
 bool Client::ReceiveMessage(bool parameters) {
-    Poco::URI request_uri(uri_.toString() + "getUpdates");
+    Poco::URI request_uri = get_updates_uri_;
 
     if (parameters) {
         if (HasOffset()) {
-            request_uri.addQueryParameter("offset", std::to_string(offset_.value()));
+            request_uri.addQueryParameter("offset", FormatInt(offset_.value()));
         }
-        request_uri.addQueryParameter("timeout", std::to_string(timeout_));
+        request_uri.addQueryParameter("timeout", FormatInt(timeout_));
     }
 
     Parser parser = MakeRequest(request_uri);
@@ -28,7 +79,8 @@ bool Client::ReceiveMessage(bool parameters) {
     //        SaveOffset();
     //    }
 
-    messages_ = parser.GetMessages();
+    messages_.clear();
+    parser.GetMessages(&messages_);
     return true;
 }
 
@@ -54,6 +106,40 @@ bool Client::HasOffset() {
 
 // todo how to pass parameters better?
 
+// Escapes a message text into out as a JSON string literal; UTF-8 bytes pass
+// through untouched.
+static void AppendJsonString(std::string* out, std::string_view text) {
+    out->push_back('"');
+    for (char symbol : text) {
+        switch (symbol) {
+            case '"':
+                out->append("\\\"");
+                break;
+            case '\\':
+                out->append("\\\\");
+                break;
+            case '\n':
+                out->append("\\n");
+                break;
+            case '\r':
+                out->append("\\r");
+                break;
+            case '\t':
+                out->append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(symbol) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", symbol);
+                    out->append(buffer);
+                } else {
+                    out->push_back(symbol);
+                }
+        }
+    }
+    out->push_back('"');
+}
+
 void Client::SendTextMessage(const int chat_id,
                              const std::vector<std::pair<std::string, std::string>>& parameters) {
     Poco::JSON::Object message;
@@ -63,22 +149,46 @@ void Client::SendTextMessage(const int chat_id,
         message.set(pair.first, pair.second);
     }
 
-    std::stringstream content;
+    send_buf_.clear();
+    StringOutputStream content(&send_buf_);
     message.stringify(content);
 
-    Poco::URI request_uri(uri_.toString() + "sendMessage");
-    Poco::Net::HTTPRequest request("POST", request_uri.getPathAndQuery());
+    PostSendBuffer();
+}
+
+void Client::SendTextMessage(int64_t chat_id, std::string_view text,
+                             std::optional<int64_t> reply_to) {
+    send_buf_.clear();
+    send_buf_ += "{\"chat_id\":";
+    send_buf_ += FormatInt(chat_id);
+    send_buf_ += ",\"text\":";
+    AppendJsonString(&send_buf_, text);
+    if (reply_to) {
+        send_buf_ += ",\"reply_to_message_id\":";
+        send_buf_ += FormatInt(*reply_to);
+    }
+    send_buf_ += '}';
+
+    PostSendBuffer();
+}
+
+void Client::PostSendBuffer() {
+    Poco::Net::HTTPRequest request("POST", send_message_uri_.getPathAndQuery());
     request.setContentType("application/json");
-    request.setContentLength(content.str().size());
+    request.setContentLength(send_buf_.size());
 
     std::ostream& request_body = session_->sendRequest(request);
-    message.stringify(request_body);
+    request_body.write(send_buf_.data(), send_buf_.size());
 
     Poco::Net::HTTPResponse response;
     std::istream* response_body;
     try {
         response_body = &session_->receiveResponse(response);
     } catch (Poco::TimeoutException) {
+        // The reply to the request just sent never arrived; it may still land
+        // in the socket later, and with keep-alive on, the next exchange would
+        // read those stale bytes as its own reply. Close the socket so a retry
+        // reconnects cleanly.
         session_->reset();
         throw std::runtime_error("Client::SendTextMessage - Poco timeout exception.");
     }
@@ -106,7 +216,11 @@ Parser Client::MakeRequest(const Poco::URI& uri) {
     try {
         response_body = &session_->receiveResponse(response);
     } catch (Poco::TimeoutException) {
-        session_.reset();
+        // An idle long poll is ended by Telegram with an empty 200 before the
+        // socket timeout fires, so a receive timeout here is a failed
+        // exchange, not the idle case. Close the socket: its late response
+        // would otherwise be read as the reply to the next request.
+        session_->reset();
         throw std::runtime_error("Poco timeout exception.");
     }
 
@@ -115,7 +229,7 @@ Parser Client::MakeRequest(const Poco::URI& uri) {
                                  " from server.");
     }
 
-    Parser parser{*response_body};
+    Parser parser{*response_body, &json_parser_, handler_.get(), &recv_buf_};
     parser.Parse();
     if (!parser.OkStatus()) {
         throw std::runtime_error("Ok status in reply is not true");
@@ -125,94 +239,149 @@ Parser Client::MakeRequest(const Poco::URI& uri) {
 }
 
 void Parser::Parse() {
-    Poco::JSON::Parser poco_parser;
-    json_ = poco_parser.parse(response_).extract<Poco::JSON::Object::Ptr>();
-    result_ = json_->getArray("result");
+    // The handler and parser are reused across polls so their internal
+    // buffers survive; reset() only rewinds their state machines.
+    handler_->reset();
+
+    buffer_->clear();
+    Poco::StreamCopier::copyToString(response_, *buffer_);
+
+    // An idle long poll answers {"ok":true,"result":[]} — by far the most
+    // frequent response — and it needs no parsing at all. The substring
+    // cannot hide inside a string value, where the quotes would be escaped.
+    bool ok_true = buffer_->find("\"ok\":true") != std::string::npos ||
+                   buffer_->find("\"ok\":\"true\"") != std::string::npos;
+    if (ok_true && buffer_->find("\"result\":[]") != std::string::npos) {
+        handler_->MarkEmptyOk();
+        return;
+    }
+
+    json_parser_->reset();
+    json_parser_->parse(*buffer_);
 }
 
 bool Parser::OkStatus() {
-    auto ok_status = json_->getValue<std::string>("ok");
-    if (ok_status != "true") {
-        return false;
-    }
-    return true;
+    return handler_->OkStatus();
 }
 
 std::optional<int64_t> Parser::GetLastUpdateId() {
-    if (result_->size() == 0) {
-        return std::nullopt;
-    }
-    return result_->getObject(result_->size() - 1)->getValue<int64_t>("update_id");
+    return handler_->GetLastUpdateId();
 }
 
-std::vector<std::shared_ptr<Message>> Parser::GetMessages() {
-    std::vector<std::shared_ptr<Message>> messages;
-
-    if (result_->size() == 0) {
-        return messages;
-    }
-
-    for (auto iterator = result_->begin(); iterator != result_->end(); ++iterator) {
-        auto update = iterator->extract<Poco::JSON::Object::Ptr>();
-        auto message = update->getObject("message");
-
-        auto message_ptr = ParseMessage(message);
-        if (!message_ptr) {
-            continue;
-        }
-
-        auto chat = message->getObject("chat");
-        message_ptr->chat.id = chat->getValue<int64_t>("id");
-        message_ptr->message_id = message->getValue<int64_t>("message_id");
-
-        messages.push_back(message_ptr);
-    }
+void Parser::GetMessages(std::vector<Message>* messages) {
+    // Swap rather than copy: the handler gets the caller's (cleared but
+    // still allocated) buffer back for the next poll.
+    messages->swap(handler_->Messages());
+}
 
-    return messages;
+void UpdateHandler::reset() {
+    stack_.clear();
+    last_key_.clear();
+    ok_ = false;
+    last_update_id_ = std::nullopt;
+    messages_.clear();
 }
 
-int Parser::GetType(Poco::SharedPtr<Poco::JSON::Object> message) {
-    if (message->has("text")) {
-        return kText;
+void UpdateHandler::startObject() {
+    if (stack_.empty()) {
+        stack_.push_back(kRoot);
+        return;
     }
-    if (message->has("sticker")) {
-        return kSticker;
+    switch (Top()) {
+        case kResultArray:
+            stack_.push_back(kUpdate);
+            break;
+        case kUpdate:
+            if (last_key_ == "message") {
+                messages_.emplace_back();
+                stack_.push_back(kMessageObj);
+            } else {
+                stack_.push_back(kSkip);
+            }
+            break;
+        case kMessageObj:
+            stack_.push_back(last_key_ == "chat" ? kChatObj : kSkip);
+            break;
+        case kEntitiesArray:
+            messages_.back().entities.emplace_back(EntityType::kOther, 0, 0);
+            stack_.push_back(kEntityObj);
+            break;
+        default:
+            stack_.push_back(kSkip);
     }
+}
 
-    return kUnknown;
+void UpdateHandler::endObject() {
+    // Only text messages are kept; anything else gives its slot back.
+    if (Top() == kMessageObj && messages_.back().type != kText) {
+        messages_.pop_back();
+    }
+    stack_.pop_back();
 }
 
-std::shared_ptr<Message> Parser::ParseMessage(Poco::SharedPtr<Poco::JSON::Object> message) {
-    int type = GetType(message);
-    switch (type) {
-        case kText:
-            return ParseTextMessage(message);
-        case kSticker:
-            return nullptr;
-        case kUnknown:
-            return nullptr;
+void UpdateHandler::startArray() {
+    switch (Top()) {
+        case kRoot:
+            stack_.push_back(last_key_ == "result" ? kResultArray : kSkip);
+            break;
+        case kMessageObj:
+            stack_.push_back(last_key_ == "entities" ? kEntitiesArray : kSkip);
+            break;
         default:
-            throw std::runtime_error("in Parser::ParseMessage(): reached default case");
+            stack_.push_back(kSkip);
     }
 }
 
-std::shared_ptr<Message> Parser::ParseTextMessage(Poco::SharedPtr<Poco::JSON::Object> message) {
-    std::string text = message->getValue<std::string>("text");
-
-    auto text_message = std::make_shared<TextMessage>(text, kText);
+void UpdateHandler::endArray() {
+    stack_.pop_back();
+}
 
-    if (message->has("entities")) {
-        auto entities = message->getArray("entities");
-        for (size_t i = 0; i < entities->size(); ++i) {
-            auto entity = entities->getObject(i);
+void UpdateHandler::key(const std::string& name) {
+    last_key_ = name;
+}
 
-            int length = entity->getValue<int>("length");
-            int offset = entity->getValue<int>("offset");
-            std::string type = entity->getValue<std::string>("type");
+void UpdateHandler::value(const std::string& text) {
+    if (Top() == kMessageObj && last_key_ == "text") {
+        messages_.back().text = text;
+        messages_.back().type = kText;
+    } else if (Top() == kEntityObj && last_key_ == "type") {
+        messages_.back().entities.back().type = ParseEntityType(text);
+    } else if (Top() == kRoot && last_key_ == "ok") {
+        ok_ = (text == "true");
+    }
+}
 
-            text_message->entities.emplace_back(type, offset, length);
-        }
+void UpdateHandler::value(bool ok) {
+    if (Top() == kRoot && last_key_ == "ok") {
+        ok_ = ok;
     }
+}
 
-    return text_message;
+void UpdateHandler::Integer(int64_t number) {
+    switch (Top()) {
+        case kUpdate:
+            if (last_key_ == "update_id") {
+                last_update_id_ = number;
+            }
+            break;
+        case kMessageObj:
+            if (last_key_ == "message_id") {
+                messages_.back().message_id = static_cast<int>(number);
+            }
+            break;
+        case kChatObj:
+            if (last_key_ == "id") {
+                messages_.back().chat.id = number;
+            }
+            break;
+        case kEntityObj:
+            if (last_key_ == "offset") {
+                messages_.back().entities.back().offset = static_cast<int>(number);
+            } else if (last_key_ == "length") {
+                messages_.back().entities.back().length = static_cast<int>(number);
+            }
+            break;
+        default:
+            break;
+    }
 }
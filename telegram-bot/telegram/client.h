@@ -5,9 +5,11 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 
+#include <Poco/JSON/Handler.h>
 #include <Poco/JSON/Object.h>
 #include <Poco/JSON/Parser.h>
 #include <Poco/Net/HTTPSClientSession.h>
@@ -24,33 +26,110 @@ struct Chat {
 
 enum MessageType { kUnknown, kText, kSticker };
 
+// Entity types form a small fixed vocabulary, so an enum replaces the
+// per-entity string: no allocation when parsing and an integer compare in
+// the bot instead of a memcmp. Types the bot has no use for map to kOther.
+enum class EntityType : uint8_t { kOther, kBotCommand, kMention, kUrl, kHashtag };
+
+EntityType ParseEntityType(const std::string& name);
+
+struct Entity {
+    Entity(EntityType type, int offset, int length) : type(type), offset(offset), length(length) {
+    }
+
+    EntityType type;
+    int offset;
+    int length;
+};
+
+// One flat struct covers every message kind; the tag says which fields are
+// meaningful (text and entities stay empty for non-text messages). With only
+// two concrete kinds a class hierarchy bought nothing but heap traffic.
 struct Message {
     Message() = default;
-    Message(MessageType type) : type(type) {
+    Message(const std::string& message_text, MessageType message_type)
+        : type(message_type), text(message_text) {
     }
+
     Chat chat;
     MessageType type = kUnknown;
     int message_id = 0;
+    std::string text;
+    std::vector<Entity> entities;
 };
 
-struct Entity {
-    Entity(const std::string& type, int offset, int length)
-        : type(type), offset(offset), length(length) {
+// Streaming (SAX) handler for getUpdates responses. Building the messages
+// directly from parser events skips the Poco DOM — a refcounted map of Var
+// per JSON node — which dominated the allocator traffic of a poll.
+class UpdateHandler : public Poco::JSON::Handler {
+public:
+    void reset() override;
+
+    void startObject() override;
+    void endObject() override;
+    void startArray() override;
+    void endArray() override;
+    void key(const std::string& name) override;
+
+    void null() override {
+    }
+    void value(int number) override {
+        Integer(number);
+    }
+    void value(unsigned number) override {
+        Integer(number);
     }
+    void value(Poco::Int64 number) override {
+        Integer(number);
+    }
+    void value(Poco::UInt64 number) override {
+        Integer(static_cast<int64_t>(number));
+    }
+    void value(const std::string& text) override;
+    void value(double) override {
+    }
+    void value(bool ok) override;
 
-    std::string type;
-    int offset;
-    int length;
-};
+    // For the empty-result fast path in Parser::Parse, which never hands the
+    // response to the JSON parser at all.
+    void MarkEmptyOk() {
+        ok_ = true;
+    }
 
-struct TextMessage : Message {
-    TextMessage(const std::string& message_text, MessageType message_type) {
-        text = message_text;
-        type = message_type;
+    bool OkStatus() const {
+        return ok_;
+    }
+    std::optional<int64_t> GetLastUpdateId() const {
+        return last_update_id_;
+    }
+    std::vector<Message>& Messages() {
+        return messages_;
     }
 
-    std::string text;
-    std::vector<Entity> entities;
+private:
+    // Where in the getUpdates response the parser currently is; unknown
+    // subtrees are skipped with kSkip entries until they close.
+    enum Context : char {
+        kRoot,
+        kResultArray,
+        kUpdate,
+        kMessageObj,
+        kChatObj,
+        kEntitiesArray,
+        kEntityObj,
+        kSkip
+    };
+
+    Context Top() const {
+        return stack_.empty() ? kRoot : stack_.back();
+    }
+    void Integer(int64_t number);
+
+    std::vector<Context> stack_;
+    std::string last_key_;
+    bool ok_ = false;
+    std::optional<int64_t> last_update_id_;
+    std::vector<Message> messages_;
 };
 
 class Parser;
@@ -59,7 +138,10 @@ class Client {
 public:
     Client(const std::string& api_key, std::string filename = "offset.txt",
            const std::string& api_url = kTelegramApiUrl)
-        : uri_(api_url + api_key + "/"), offset_filename_(filename) {
+        : uri_(api_url + api_key + "/"),
+          get_updates_uri_(api_url + api_key + "/getUpdates"),
+          send_message_uri_(api_url + api_key + "/sendMessage"),
+          offset_filename_(filename) {
         if (uri_.getScheme() == "http") {
             session_ =
                 std::make_shared<Poco::Net::HTTPClientSession>(uri_.getHost(), uri_.getPort());
@@ -67,6 +149,9 @@ public:
             session_ =
                 std::make_shared<Poco::Net::HTTPSClientSession>(uri_.getHost(), uri_.getPort());
         }
+        // Long-polling reconnects every few seconds otherwise, and the TLS
+        // handshake dominates the latency of an idle poll.
+        session_->setKeepAlive(true);
     }
 
     void SetTimeout(int timeout) {
@@ -78,44 +163,61 @@ public:
     bool HasOffset();
     void SendTextMessage(const int chat_id,
                          const std::vector<std::pair<std::string, std::string>>& parameters);
-
-    std::vector<std::shared_ptr<Message>> GetMessages() {
-        return std::move(messages_);
+    // Fast path for plain replies: the JSON body is written straight into the
+    // send buffer, with no parameter vector and no Poco object in between.
+    // chat_id is int64_t: group and supergroup ids are negative and can fall
+    // below the int range.
+    void SendTextMessage(int64_t chat_id, std::string_view text,
+                         std::optional<int64_t> reply_to = std::nullopt);
+
+    // Messages live by value in a buffer that is reused across polls; only
+    // text messages ever reach the bot, so no polymorphism is needed.
+    const std::vector<Message>& GetMessages() const {
+        return messages_;
     }
 
 private:
     void SaveOffset();
+    void PostSendBuffer();
 
 private:
     Poco::URI uri_;
+    // Endpoint URLs never change, so they are parsed once here instead of
+    // being rebuilt (string concat + URL parse) on every call.
+    Poco::URI get_updates_uri_;
+    Poco::URI send_message_uri_;
     std::shared_ptr<Poco::Net::HTTPClientSession> session_;
 
     std::optional<int64_t> offset_;
     int timeout_ = 3;  // in seconds
     std::string offset_filename_;
 
-    std::vector<std::shared_ptr<Message>> messages_;
+    std::vector<Message> messages_;
+    std::string send_buf_;  // outgoing JSON, reused across sends
+    std::string recv_buf_;  // response body, reused across polls
+    // The handler and its parser are reused across polls so their buffers
+    // survive between requests; declaration order matters here.
+    Poco::SharedPtr<UpdateHandler> handler_{new UpdateHandler};
+    Poco::JSON::Parser json_parser_{handler_};
 };
 
 class Parser {
 public:
-    Parser(std::istream& response) : response_(response) {
+    Parser(std::istream& response, Poco::JSON::Parser* json_parser, UpdateHandler* handler,
+           std::string* buffer)
+        : response_(response), json_parser_(json_parser), handler_(handler), buffer_(buffer) {
     }
     bool OkStatus();
 
     void Parse();
     std::optional<int64_t> GetLastUpdateId();
-    std::vector<std::shared_ptr<Message>> GetMessages();
-
-private:
-    std::shared_ptr<Message> ParseMessage(Poco::SharedPtr<Poco::JSON::Object> message);
-    int GetType(Poco::SharedPtr<Poco::JSON::Object> message);
-    std::shared_ptr<Message> ParseTextMessage(Poco::SharedPtr<Poco::JSON::Object> message);
+    void GetMessages(std::vector<Message>* messages);
 
 private:
     std::istream& response_;
-    Poco::JSON::Object::Ptr json_;
-    Poco::SharedPtr<Poco::JSON::Array> result_;
+    Poco::JSON::Parser* json_parser_;
+    UpdateHandler* handler_;
+    std::string* buffer_;
 };
 
 #endif  // SHAD_CPP0_CLIENT_H
@@ -42,9 +42,9 @@ TEST_CASE("Single getUpdates and send messages") {
     Client client("bot123", "offset.txt", fake.GetUrl());
 
     client.ReceiveMessage(false);
-    auto messages = client.GetMessages();
+    const auto& messages = client.GetMessages();
 
-    int chat_id = messages[0]->chat.id;
+    int chat_id = messages[0].chat.id;
 
     std::vector<std::pair<std::string, std::string>> parameters;
     parameters.emplace_back("text", "Hi!");